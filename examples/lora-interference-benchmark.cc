@@ -0,0 +1,259 @@
+/*
+ * This program measures the cost of the LoraInterferenceHelper operations.
+ *
+ * For each interference model and for populations of 10 up to maxEvents
+ * events, concurrent events are generated with random SFs, frequencies and
+ * powers. The program times the Add calls that build the population, then
+ * the IsDestroyedByInterference and GetSINR calls on random events of the
+ * population. For each operation it reports the average time and the
+ * average number of heap allocations per call.
+ */
+
+#include "ns3/lora-interference-helper.h"
+#include "ns3/lora-phy.h"
+#include "ns3/lora-tag.h"
+#include "ns3/simulator.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/log.h"
+#include "ns3/abort.h"
+#include "ns3/command-line.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <vector>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("LoraInterferenceBenchmark");
+
+// Count all the heap allocations made by the program
+static uint64_t g_allocations = 0;
+
+void *
+operator new (size_t size)
+{
+  g_allocations++;
+  void *p = std::malloc (size == 0 ? 1 : size);
+  if (p == 0)
+    {
+      throw std::bad_alloc ();
+    }
+  return p;
+}
+
+void
+operator delete (void *p) noexcept
+{
+  std::free (p);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * The measurements of an operation.
+ */
+struct Measurement
+{
+  uint64_t calls;
+  uint64_t nanoseconds;
+  uint64_t allocations;
+};
+
+/**
+ * The state of a benchmark run on a population of events.
+ */
+struct Population
+{
+  LoraInterferenceHelper helper;
+  Ptr<Packet> packet;
+  std::vector<Ptr<LoraInterferenceHelper::Event> > events;
+  Measurement add;
+  Measurement destroyed;
+  Measurement sinr;
+  uint32_t queries;
+  Ptr<UniformRandomVariable> random;
+};
+
+static Time g_duration[6];
+
+static const double g_frequencies[3] = {868.1, 868.3, 868.5};
+
+void
+AddEvent (Population *population, uint8_t sf, double frequencyMHz,
+          double rxPowerDbm)
+{
+  uint64_t allocations = g_allocations;
+  Clock::time_point start = Clock::now ();
+
+  Ptr<LoraInterferenceHelper::Event> event =
+    population->helper.Add (g_duration[sf-7], rxPowerDbm, sf,
+                            population->packet, frequencyMHz);
+
+  Clock::time_point end = Clock::now ();
+  population->add.nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>
+      (end - start).count ();
+  population->add.allocations += g_allocations - allocations;
+  population->add.calls++;
+
+  population->events.push_back (event);
+}
+
+void
+Query (Population *population)
+{
+  uint32_t n = population->events.size ();
+
+  // Draw the events to evaluate beforehand, so that only the evaluation is
+  // measured
+  std::vector<Ptr<LoraInterferenceHelper::Event> > queried;
+  for (uint32_t i = 0; i < population->queries; i++)
+    {
+      queried.push_back (population->events[population->random->GetInteger (0, n-1)]);
+    }
+
+  // Keep the results, so that the calls are not optimised away
+  uint32_t nDestroyed = 0;
+  double sinrSum = 0;
+
+  uint64_t allocations = g_allocations;
+  Clock::time_point start = Clock::now ();
+  for (uint32_t i = 0; i < queried.size (); i++)
+    {
+      nDestroyed += population->helper.IsDestroyedByInterference (queried[i]);
+    }
+  Clock::time_point end = Clock::now ();
+  population->destroyed.nanoseconds +=
+    std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count ();
+  population->destroyed.allocations += g_allocations - allocations;
+  population->destroyed.calls += queried.size ();
+
+  allocations = g_allocations;
+  start = Clock::now ();
+  for (uint32_t i = 0; i < queried.size (); i++)
+    {
+      sinrSum += population->helper.GetSINR (queried[i]);
+    }
+  end = Clock::now ();
+  population->sinr.nanoseconds +=
+    std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count ();
+  population->sinr.allocations += g_allocations - allocations;
+  population->sinr.calls += queried.size ();
+
+  NS_LOG_DEBUG ("Destroyed: " << nDestroyed << ", average SINR: " <<
+                sinrSum / queried.size ());
+}
+
+void
+Print (std::string model, uint32_t nEvents, std::string operation,
+       Measurement measurement)
+{
+  std::cout << std::left << std::setw (18) << model << std::right <<
+    std::setw (10) << nEvents << "  " << std::left << std::setw (28) <<
+    operation << std::right << std::fixed << std::setprecision (1) <<
+    std::setw (12) << double(measurement.nanoseconds) / measurement.calls <<
+    std::setw (14) << std::setprecision (3) <<
+    double(measurement.allocations) / measurement.calls << std::endl;
+}
+
+int main (int argc, char *argv[])
+{
+  uint32_t maxEvents = 100000;
+  uint32_t queries = 1000;
+  double window = 0.01;
+  uint32_t seed = 1;
+
+  CommandLine cmd;
+  cmd.AddValue ("maxEvents", "Largest number of concurrent events", maxEvents);
+  cmd.AddValue ("queries", "Number of evaluations per population and operation", queries);
+  cmd.AddValue ("window", "Interval [s] in which the events start", window);
+  cmd.AddValue ("seed", "Seed of the random number generator", seed);
+  cmd.Parse (argc, argv);
+
+  RngSeedManager::SetSeed (seed);
+
+  // Every event lasts longer than the window, so that all the events of a
+  // population are on the air together when they are evaluated
+  Ptr<Packet> packet = Create<Packet> (20);
+  LoraTxParameters txParams;
+  txParams.headerDisabled = false;
+  for (uint8_t sf = 7; sf <= 12; sf++)
+    {
+      txParams.sf = sf;
+      txParams.lowDataRateOptimizationEnabled = (sf >= 11);
+      g_duration[sf-7] = LoraPhy::GetOnAirTime (packet, txParams);
+    }
+  NS_ABORT_MSG_IF (Seconds (window) >= g_duration[0],
+                   "The window must be shorter than the SF7 on-air time");
+
+  LoraTag tag;
+  tag.SetPreamble (LoraPhy::GetPreambleTime (7, 125000, 8).GetSeconds ());
+  packet->AddPacketTag (tag);
+
+  const LoraInterferenceHelper::Int_Model models[4] =
+  {
+    LoraInterferenceHelper::Pure_ALOHA,
+    LoraInterferenceHelper::CE_PowerLevel,
+    LoraInterferenceHelper::CE_CumulEnergy,
+    LoraInterferenceHelper::Cochannel_Matrix
+  };
+  const std::string modelNames[4] =
+  {
+    "Pure_ALOHA", "CE_PowerLevel", "CE_CumulEnergy", "Cochannel_Matrix"
+  };
+
+  std::cout << std::left << std::setw (18) << "Model" << std::right <<
+    std::setw (10) << "Events" << "  " << std::left << std::setw (28) <<
+    "Operation" << std::right << std::setw (12) << "ns/call" <<
+    std::setw (14) << "allocs/call" << std::endl;
+
+  for (uint32_t m = 0; m < 4; m++)
+    {
+      for (uint32_t nEvents = 10; nEvents <= maxEvents; nEvents *= 10)
+        {
+          Population population;
+          population.helper.SetInterferenceModel (models[m]);
+          population.packet = packet;
+          population.add.calls = 0;
+          population.add.nanoseconds = 0;
+          population.add.allocations = 0;
+          population.destroyed = population.add;
+          population.sinr = population.add;
+          population.queries = queries;
+          population.random = CreateObject<UniformRandomVariable> ();
+          population.events.reserve (nEvents);
+
+          // Draw the start times first, since events are added at the
+          // current simulation time
+          std::vector<double> starts;
+          for (uint32_t i = 0; i < nEvents; i++)
+            {
+              starts.push_back (population.random->GetValue (0, window));
+            }
+          std::sort (starts.begin (), starts.end ());
+
+          for (uint32_t i = 0; i < nEvents; i++)
+            {
+              uint8_t sf = population.random->GetInteger (7, 12);
+              double frequency = g_frequencies[population.random->GetInteger (0, 2)];
+              double rxPowerDbm = population.random->GetValue (-130, -80);
+              Simulator::Schedule (Seconds (starts[i]), &AddEvent, &population,
+                                   sf, frequency, rxPowerDbm);
+            }
+          Simulator::Schedule (Seconds (window), &Query, &population);
+
+          Simulator::Run ();
+          Simulator::Destroy ();
+
+          Print (modelNames[m], nEvents, "Add", population.add);
+          Print (modelNames[m], nEvents, "IsDestroyedByInterference",
+                 population.destroyed);
+          Print (modelNames[m], nEvents, "GetSINR", population.sinr);
+        }
+    }
+
+  return 0;
+}
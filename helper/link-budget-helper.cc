@@ -0,0 +1,218 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * LoRaWAN Jamming - Copyright (c) 2019 INSA de Rennes
+ * LoRaWAN ns-3 module v 0.1.0 - Copyright (c) 2017 University of Padova
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * LoRaWAN ns-3 module v 0.1.0 author: Davide Magrin <magrinda@dei.unipd.it>
+ * LoRaWAN Jamming author: Ivan Martinez <ivamarti@insa-rennes.fr>
+ */
+
+#include "ns3/link-budget-helper.h"
+#include "ns3/log.h"
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LinkBudgetHelper");
+
+namespace {
+
+const char g_magic[8] = {'L', 'O', 'R', 'A', 'L', 'I', 'N', 'K'};
+const uint32_t g_version = 1;
+
+}
+
+/**
+ * A table of links that lives in a file mapped in memory.
+ */
+class MappedLinkTable : public LoraChannel::LinkTable
+{
+public:
+  MappedLinkTable (void *address, size_t size, size_t offset)
+    : m_address (address),
+      m_size (size),
+      m_offset (offset)
+  {
+  }
+
+  virtual ~MappedLinkTable ()
+  {
+    munmap (m_address, m_size);
+  }
+
+  virtual const LoraChannel::Link * GetLinks (void) const
+  {
+    return reinterpret_cast<const LoraChannel::Link *>
+           (static_cast<const char *> (m_address) + m_offset);
+  }
+
+private:
+  void *m_address; //!< The beginning of the mapping.
+  size_t m_size; //!< The size of the mapping.
+  size_t m_offset; //!< The offset of the links in the mapping.
+};
+
+LinkBudgetHelper::LinkBudgetHelper ()
+{
+}
+
+LinkBudgetHelper::~LinkBudgetHelper ()
+{
+}
+
+bool
+LinkBudgetHelper::Write (Ptr<LoraChannel> channel, std::string filename) const
+{
+  NS_LOG_FUNCTION (this << channel << filename);
+
+  if (channel->HasStochasticLoss ())
+    {
+      NS_LOG_WARN ("Not writing " << filename << ": the loss models are "
+                   "stochastic");
+      return false;
+    }
+
+  Header header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, g_magic, sizeof (header.magic));
+  header.version = g_version;
+  header.nPhys = channel->GetNDevices ();
+  header.checksum = channel->GetTopologyChecksum ();
+
+  std::ofstream file (filename.c_str (), std::ios::binary | std::ios::trunc);
+  if (!file)
+    {
+      NS_LOG_WARN ("Cannot open " << filename << " for writing");
+      return false;
+    }
+  file.write (reinterpret_cast<const char *> (&header), sizeof (header));
+
+  // Write the links of one sender at a time
+  std::vector<LoraChannel::Link> links (header.nPhys);
+  for (uint32_t i = 0; i < header.nPhys; i++)
+    {
+      for (uint32_t j = 0; j < header.nPhys; j++)
+        {
+          links[j] = channel->GetLinkBudget (i, j);
+        }
+      if (header.nPhys > 0)
+        {
+          file.write (reinterpret_cast<const char *> (&links[0]),
+                      header.nPhys * sizeof (LoraChannel::Link));
+        }
+    }
+
+  if (!file)
+    {
+      NS_LOG_WARN ("Cannot write " << filename);
+      return false;
+    }
+
+  NS_LOG_INFO ("Wrote the links of " << header.nPhys << " PHYs to " <<
+               filename);
+  return true;
+}
+
+bool
+LinkBudgetHelper::Load (Ptr<LoraChannel> channel, std::string filename) const
+{
+  NS_LOG_FUNCTION (this << channel << filename);
+
+  if (channel->HasStochasticLoss ())
+    {
+      NS_LOG_WARN ("Not loading " << filename << ": the loss models are "
+                   "stochastic");
+      return false;
+    }
+
+  int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      NS_LOG_INFO ("Cannot open " << filename);
+      return false;
+    }
+
+  struct stat status;
+  if (fstat (fd, &status) != 0 || size_t (status.st_size) < sizeof (Header))
+    {
+      NS_LOG_WARN (filename << " is not a link file");
+      close (fd);
+      return false;
+    }
+
+  size_t size = status.st_size;
+  void *address = mmap (0, size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (address == MAP_FAILED)
+    {
+      NS_LOG_WARN ("Cannot map " << filename);
+      return false;
+    }
+
+  Header header;
+  std::memcpy (&header, address, sizeof (header));
+  uint64_t nPhys = channel->GetNDevices ();
+
+  const char *problem = 0;
+  if (std::memcmp (header.magic, g_magic, sizeof (header.magic)) != 0
+      || header.version != g_version)
+    {
+      problem = "has an unknown format";
+    }
+  else if (header.nPhys != nPhys
+           || size != sizeof (header) + nPhys * nPhys * sizeof (LoraChannel::Link))
+    {
+      problem = "does not match the number of PHYs";
+    }
+  else if (header.checksum != channel->GetTopologyChecksum ())
+    {
+      problem = "was written for another topology";
+    }
+
+  if (problem != 0)
+    {
+      NS_LOG_WARN (filename << " " << problem);
+      munmap (address, size);
+      return false;
+    }
+
+  channel->SetLinkTable (Create<MappedLinkTable> (address, size,
+                                                  sizeof (header)));
+
+  NS_LOG_INFO ("Loaded the links of " << nPhys << " PHYs from " << filename);
+  return true;
+}
+
+bool
+LinkBudgetHelper::LoadOrWrite (Ptr<LoraChannel> channel,
+                               std::string filename) const
+{
+  NS_LOG_FUNCTION (this << channel << filename);
+
+  if (Load (channel, filename))
+    {
+      return true;
+    }
+
+  return Write (channel, filename) && Load (channel, filename);
+}
+
+} // namespace ns3
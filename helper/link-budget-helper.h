@@ -0,0 +1,99 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * LoRaWAN Jamming - Copyright (c) 2019 INSA de Rennes
+ * LoRaWAN ns-3 module v 0.1.0 - Copyright (c) 2017 University of Padova
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * LoRaWAN ns-3 module v 0.1.0 author: Davide Magrin <magrinda@dei.unipd.it>
+ * LoRaWAN Jamming author: Ivan Martinez <ivamarti@insa-rennes.fr>
+ */
+
+#ifndef LINK_BUDGET_HELPER_H
+#define LINK_BUDGET_HELPER_H
+
+#include "ns3/lora-channel.h"
+#include <stdint.h>
+#include <string>
+
+namespace ns3 {
+
+/**
+ * This class can be used to store the links between all the PHYs of a
+ * LoraChannel in a file, and to reuse them in later runs with the same
+ * topology.
+ *
+ * The file holds a header and the links of LoraChannel::GetLinkBudget, by
+ * sender and then by receiver, in the byte order of the machine. It is mapped
+ * in memory when loaded, so that runs sharing a topology also share the
+ * pages of the file.
+ */
+class LinkBudgetHelper
+{
+public:
+  LinkBudgetHelper ();
+
+  ~LinkBudgetHelper ();
+
+  /**
+   * Compute the links between all the PHYs of a channel and write them to a
+   * file.
+   *
+   * Nothing is written if the loss models of the channel are stochastic.
+   *
+   * \param channel The channel, with all its PHYs in place.
+   * \param filename The file to write.
+   * \return Whether the file was written.
+   */
+  bool Write (Ptr<LoraChannel> channel, std::string filename) const;
+
+  /**
+   * Make a channel use the links stored in a file.
+   *
+   * The file is only used if it was written for the same topology, as
+   * described by LoraChannel::GetTopologyChecksum, and if the loss models
+   * of the channel are not stochastic.
+   *
+   * \param channel The channel, with all its PHYs in place.
+   * \param filename The file to read.
+   * \return Whether the file was used.
+   */
+  bool Load (Ptr<LoraChannel> channel, std::string filename) const;
+
+  /**
+   * Make a channel use the links stored in a file, writing the file first if
+   * it is missing or stale.
+   *
+   * \param channel The channel, with all its PHYs in place.
+   * \param filename The file to use.
+   * \return Whether the channel uses the file.
+   */
+  bool LoadOrWrite (Ptr<LoraChannel> channel, std::string filename) const;
+
+private:
+  /**
+   * The header at the beginning of the file.
+   */
+  struct Header
+  {
+    char magic[8]; //!< Identifies the format of the file.
+    uint32_t version; //!< The version of the format.
+    uint32_t nPhys; //!< The number of PHYs in the channel.
+    uint64_t checksum; //!< The checksum of the topology.
+  };
+};
+
+} // namespace ns3
+
+#endif /* LINK_BUDGET_HELPER_H */
@@ -21,8 +21,10 @@
  */
 
 #include "ns3/lora-interference-helper.h"
+#include "ns3/lora-phy.h"
 #include "ns3/log.h"
 #include <limits>
+#include <algorithm>
 
 using namespace std;
 namespace ns3 {
@@ -30,48 +32,227 @@ namespace ns3 {
 NS_LOG_COMPONENT_DEFINE ("LoraInterferenceHelper");
 
 
+/**********************************************
+ *    LoraInterferenceHelper::Transmission    *
+ **********************************************/
+
+uint64_t LoraInterferenceHelper::Transmission::s_nextId = 0;
+
+LoraInterferenceHelper::Transmission::Transmission (Time duration,
+                                                    uint8_t spreadingFactor,
+                                                    Ptr<Packet> packet,
+                                                    double frequencyMHz) :
+  m_id (s_nextId++),
+  m_duration (duration),
+  m_sf (spreadingFactor),
+  m_packet (packet),
+  m_frequencyMHz (frequencyMHz)
+{
+  LoraTag tag;
+  if (packet != 0)
+    {
+      packet->PeekPacketTag (tag);
+    }
+  m_senderId = tag.GetSenderID ();
+  m_jammer = tag.GetJammer ();
+  m_preamble = Seconds (tag.GetPreamble ());
+  m_packetId = tag.GetPktID ();
+  m_ntx = tag.Getntx ();
+}
+
+LoraInterferenceHelper::Transmission::~Transmission ()
+{
+}
+
+uint64_t
+LoraInterferenceHelper::Transmission::GetId (void) const
+{
+  return m_id;
+}
+
+uint32_t
+LoraInterferenceHelper::Transmission::GetSenderId (void) const
+{
+  return m_senderId;
+}
+
+bool
+LoraInterferenceHelper::Transmission::IsJammer (void) const
+{
+  return m_jammer;
+}
+
+Time
+LoraInterferenceHelper::Transmission::GetPreamble (void) const
+{
+  return m_preamble;
+}
+
+uint32_t
+LoraInterferenceHelper::Transmission::GetPacketId (void) const
+{
+  return m_packetId;
+}
+
+uint32_t
+LoraInterferenceHelper::Transmission::GetNtx (void) const
+{
+  return m_ntx;
+}
+
+Time
+LoraInterferenceHelper::Transmission::GetDuration (void) const
+{
+  return m_duration;
+}
+
+uint8_t
+LoraInterferenceHelper::Transmission::GetSpreadingFactor (void) const
+{
+  return m_sf;
+}
+
+Ptr<Packet>
+LoraInterferenceHelper::Transmission::GetPacket (void) const
+{
+  return m_packet;
+}
+
+double
+LoraInterferenceHelper::Transmission::GetFrequency (void) const
+{
+  return m_frequencyMHz;
+}
+
 /***************************************
  *    LoraInterferenceHelper::Event    *
  ***************************************/
 
 // Event Constructor
-LoraInterferenceHelper::Event::Event (Time duration, double rxPowerdBm,
-                                      uint8_t spreadingFactor,
-                                      Ptr<Packet> packet, double frequencyMHz) :
-  m_startTime (Simulator::Now ()),
-  m_endTime (m_startTime + duration),
-  m_sf (spreadingFactor),
+LoraInterferenceHelper::Event::Event (Ptr<const LoraInterferenceHelper::Transmission>
+                                      transmission, double rxPowerdBm) :
+  m_transmission (transmission),
+  m_startTick (Simulator::Now ().GetTimeStep ()),
+  m_endTick ((Simulator::Now () + transmission->GetDuration ()).GetTimeStep ()),
   m_rxPowerdBm (rxPowerdBm),
-  m_packet (packet),
-  m_frequencyMHz (frequencyMHz)
+  m_demodulator (-1),
+  m_backgroundEnergyAtStart (0)
 {
+  // Power [W] = 10^(Power[dBm]/10) / 1000
+  m_rxPowerW = pow (10, m_rxPowerdBm/10) / 1000;
 
 	// NS_LOG_FUNCTION_NOARGS ();
 }
 
+LoraInterferenceHelper::Event::Event (Ptr<const LoraInterferenceHelper::Transmission>
+                                      transmission, double rxPowerdBm,
+                                      int64_t startTick, int64_t endTick) :
+  m_transmission (transmission),
+  m_startTick (startTick),
+  m_endTick (endTick),
+  m_rxPowerdBm (rxPowerdBm),
+  m_demodulator (-1),
+  m_backgroundEnergyAtStart (0)
+{
+  m_rxPowerW = pow (10, m_rxPowerdBm/10) / 1000;
+}
+
 // Event Destructor
 LoraInterferenceHelper::Event::~Event ()
 {
   // NS_LOG_FUNCTION_NOARGS ();
 }
 
+// Free list of the memory blocks of deleted events, each block storing a
+// pointer to the next one
+static void *g_eventFreeList = 0;
+
+void *
+LoraInterferenceHelper::Event::operator new (size_t size)
+{
+  NS_ASSERT (size == sizeof (LoraInterferenceHelper::Event));
+
+  if (g_eventFreeList == 0)
+    {
+      return ::operator new (size);
+    }
+
+  void *block = g_eventFreeList;
+  g_eventFreeList = *static_cast<void **> (block);
+  return block;
+}
+
+void
+LoraInterferenceHelper::Event::operator delete (void *p)
+{
+  if (p == 0)
+    {
+      return;
+    }
+
+  *static_cast<void **> (p) = g_eventFreeList;
+  g_eventFreeList = p;
+}
+
 // Getters
+Ptr<const LoraInterferenceHelper::Transmission>
+LoraInterferenceHelper::Event::GetTransmission (void) const
+{
+  return m_transmission;
+}
+
+void
+LoraInterferenceHelper::Event::SetDemodulator (int32_t demodulator)
+{
+  m_demodulator = demodulator;
+}
+
+int32_t
+LoraInterferenceHelper::Event::GetDemodulator (void) const
+{
+  return m_demodulator;
+}
+
+void
+LoraInterferenceHelper::Event::SetBackgroundEnergyAtStart (double energy)
+{
+  m_backgroundEnergyAtStart = energy;
+}
+
+double
+LoraInterferenceHelper::Event::GetBackgroundEnergyAtStart (void) const
+{
+  return m_backgroundEnergyAtStart;
+}
+
 Time
 LoraInterferenceHelper::Event::GetStartTime (void) const
 {
-  return m_startTime;
+  return TimeStep (m_startTick);
 }
 
 Time
 LoraInterferenceHelper::Event::GetEndTime (void) const
 {
-  return m_endTime;
+  return TimeStep (m_endTick);
 }
 
 Time
 LoraInterferenceHelper::Event::GetDuration (void) const
 {
-  return m_endTime - m_startTime;
+  return TimeStep (m_endTick - m_startTick);
+}
+
+int64_t
+LoraInterferenceHelper::Event::GetStartTick (void) const
+{
+  return m_startTick;
+}
+
+int64_t
+LoraInterferenceHelper::Event::GetEndTick (void) const
+{
+  return m_endTick;
 }
 
 double
@@ -80,30 +261,37 @@ LoraInterferenceHelper::Event::GetRxPowerdBm (void) const
   return m_rxPowerdBm;
 }
 
+double
+LoraInterferenceHelper::Event::GetRxPowerW (void) const
+{
+  return m_rxPowerW;
+}
+
 uint8_t
 LoraInterferenceHelper::Event::GetSpreadingFactor (void) const
 {
-  return m_sf;
+  return m_transmission->GetSpreadingFactor ();
 }
 
 Ptr<Packet>
 LoraInterferenceHelper::Event::GetPacket (void) const
 {
-  return m_packet;
+  return m_transmission->GetPacket ();
 }
 
 double
 LoraInterferenceHelper::Event::GetFrequency (void) const
 {
-  return m_frequencyMHz;
+  return m_transmission->GetFrequency ();
 }
 
 void
 LoraInterferenceHelper::Event::Print (ostream &stream) const
 {
-  stream << "(" << m_startTime.GetSeconds () << " s - " <<
-  m_endTime.GetSeconds () << " s), SF" << unsigned(m_sf) << ", " <<
-  m_rxPowerdBm << " dBm, "<< m_frequencyMHz << " MHz";
+  stream << "(" << GetStartTime ().GetSeconds () << " s - " <<
+  GetEndTime ().GetSeconds () << " s), SF" <<
+  unsigned(GetSpreadingFactor ()) << ", " << m_rxPowerdBm << " dBm, " <<
+  GetFrequency () << " MHz, transmission " << m_transmission->GetId ();
 }
 
 ostream &operator << (ostream &os, const LoraInterferenceHelper::Event &event)
@@ -113,6 +301,139 @@ ostream &operator << (ostream &os, const LoraInterferenceHelper::Event &event)
   return os;
 }
 
+/*********************************************
+ *    LoraInterferenceHelper::EventBucket    *
+ *********************************************/
+
+LoraInterferenceHelper::EventBucket::EventBucket () :
+  m_first (0),
+  m_maxDuration (0)
+{
+}
+
+void
+LoraInterferenceHelper::EventBucket::Insert (Ptr<LoraInterferenceHelper::Event>
+                                             event)
+{
+  NS_ASSERT (m_first == m_transmissions.size () ||
+             m_startTicks.back () <= event->GetStartTick ());
+
+  m_startTicks.push_back (event->GetStartTick ());
+  m_endTicks.push_back (event->GetEndTick ());
+  m_rxPowerW.push_back (event->GetRxPowerW ());
+  m_rxPowerdBm.push_back (event->GetRxPowerdBm ());
+  m_transmissions.push_back (event->GetTransmission ());
+  m_maxDuration = max (m_maxDuration,
+                       event->GetEndTick () - event->GetStartTick ());
+}
+
+uint32_t
+LoraInterferenceHelper::EventBucket::Begin (void) const
+{
+  return m_first;
+}
+
+uint32_t
+LoraInterferenceHelper::EventBucket::End (void) const
+{
+  return m_transmissions.size ();
+}
+
+uint32_t
+LoraInterferenceHelper::EventBucket::OverlapBegin (int64_t startTick) const
+{
+  // No event that started more than m_maxDuration before start can still be
+  // on the air at start
+  return lower_bound (m_startTicks.begin () + m_first, m_startTicks.end (),
+                      startTick - m_maxDuration) - m_startTicks.begin ();
+}
+
+uint32_t
+LoraInterferenceHelper::EventBucket::OverlapEnd (int64_t endTick) const
+{
+  return upper_bound (m_startTicks.begin () + m_first, m_startTicks.end (),
+                      endTick) - m_startTicks.begin ();
+}
+
+int64_t
+LoraInterferenceHelper::EventBucket::GetStartTick (uint32_t i) const
+{
+  return m_startTicks[i];
+}
+
+int64_t
+LoraInterferenceHelper::EventBucket::GetEndTick (uint32_t i) const
+{
+  return m_endTicks[i];
+}
+
+double
+LoraInterferenceHelper::EventBucket::GetRxPowerW (uint32_t i) const
+{
+  return m_rxPowerW[i];
+}
+
+double
+LoraInterferenceHelper::EventBucket::GetRxPowerdBm (uint32_t i) const
+{
+  return m_rxPowerdBm[i];
+}
+
+const Ptr<const LoraInterferenceHelper::Transmission> &
+LoraInterferenceHelper::EventBucket::GetTransmission (uint32_t i) const
+{
+  return m_transmissions[i];
+}
+
+void
+LoraInterferenceHelper::EventBucket::PopFront (void)
+{
+  NS_ASSERT (m_first < m_transmissions.size ());
+
+  m_transmissions[m_first] = 0;
+  m_first++;
+
+  if (m_first == m_transmissions.size ())
+    {
+      Clear ();
+    }
+  else
+    {
+      Recycle ();
+    }
+}
+
+void
+LoraInterferenceHelper::EventBucket::Recycle (void)
+{
+  if (m_first == 0 || 2 * m_first <= m_transmissions.size ())
+    {
+      return;
+    }
+
+  // Erasing keeps the capacity of the columns, which is then reused by the
+  // following insertions
+  m_startTicks.erase (m_startTicks.begin (), m_startTicks.begin () + m_first);
+  m_endTicks.erase (m_endTicks.begin (), m_endTicks.begin () + m_first);
+  m_rxPowerW.erase (m_rxPowerW.begin (), m_rxPowerW.begin () + m_first);
+  m_rxPowerdBm.erase (m_rxPowerdBm.begin (), m_rxPowerdBm.begin () + m_first);
+  m_transmissions.erase (m_transmissions.begin (),
+                         m_transmissions.begin () + m_first);
+  m_first = 0;
+}
+
+void
+LoraInterferenceHelper::EventBucket::Clear (void)
+{
+  m_startTicks.clear ();
+  m_endTicks.clear ();
+  m_rxPowerW.clear ();
+  m_rxPowerdBm.clear ();
+  m_transmissions.clear ();
+  m_first = 0;
+  m_maxDuration = 0;
+}
+
 /****************************
  *  LoraInterferenceHelper  *
  ****************************/
@@ -130,16 +451,16 @@ LoraInterferenceHelper::GetTypeId (void)
 }
 
 LoraInterferenceHelper::LoraInterferenceHelper() :
-	m_onthepreamble(false),
-	m_preamble (false),
-	m_ce (false),
-	m_colstart(Seconds(0)),
-	m_colend(Seconds(0)),
-	m_colsf (uint8_t(0)),
 	m_intmodel (Pure_ALOHA),
-	m_delta (6)
+	m_delta (6),
+	m_nEvents (0),
+	m_horizon (GetMaxOnAirTime ()),
+	m_highWaterMark (0),
+	m_nBackgroundSignals (0)
 
 {
+  m_deltaLinear = pow (10, double(GetDelta ())/10);
+  m_model = LookupModel (uint8_t (m_intmodel) + 1);
   //NS_LOG_FUNCTION (this);
 }
 
@@ -177,747 +498,754 @@ const double LoraInterferenceHelper::collisionSnir[6][6] =
   {-36, -36, -36, -36, -36,   6}   // SF12
 };
 
-Time LoraInterferenceHelper::oldEventThreshold = Seconds (2);
+static double
+DbToLinear (double db)
+{
+  return pow (10, db/10);
+}
 
-Ptr<LoraInterferenceHelper::Event>
-LoraInterferenceHelper::Add (Time duration, double rxPower,
-                             uint8_t spreadingFactor, Ptr<Packet> packet,
-                             double frequencyMHz)
+const double LoraInterferenceHelper::collisionSnirLinear[6][6] =
 {
+  {DbToLinear (6), DbToLinear (-16), DbToLinear (-18), DbToLinear (-19), DbToLinear (-19), DbToLinear (-20)},
+  {DbToLinear (-24), DbToLinear (6), DbToLinear (-20), DbToLinear (-22), DbToLinear (-22), DbToLinear (-22)},
+  {DbToLinear (-27), DbToLinear (-27), DbToLinear (6), DbToLinear (-23), DbToLinear (-25), DbToLinear (-25)},
+  {DbToLinear (-30), DbToLinear (-30), DbToLinear (-30), DbToLinear (6), DbToLinear (-26), DbToLinear (-28)},
+  {DbToLinear (-33), DbToLinear (-33), DbToLinear (-33), DbToLinear (-33), DbToLinear (6), DbToLinear (-29)},
+  {DbToLinear (-36), DbToLinear (-36), DbToLinear (-36), DbToLinear (-36), DbToLinear (-36), DbToLinear (6)}
+};
 
-  //NS_LOG_FUNCTION (this << duration.GetSeconds () << rxPower << unsigned
-  //                 (spreadingFactor) << packet << frequencyMHz << m_intmodel << Simulator::Now ().GetSeconds ());
+/****************************************
+ *    LoraInterferenceHelper::Model    *
+ ****************************************/
 
-  // Create an event based on the parameters
-  Ptr<LoraInterferenceHelper::Event> event =
-    Create<LoraInterferenceHelper::Event> (duration, rxPower, spreadingFactor,
-                                           packet, frequencyMHz);
+LoraInterferenceHelper::Model::~Model ()
+{
+}
+
+// Any overlapping interferer using the same SF destroys the event
+struct PureAlohaPolicy
+{
+  static const bool crossSf = false;
+
+  static void
+  Decide (const LoraInterferenceHelper &helper,
+          Ptr<LoraInterferenceHelper::Event> event,
+          LoraInterferenceHelper::Result &result)
+  {
+    result.destroyed = (result.nInterferers > 0);
+    if (result.destroyed)
+      {
+        result.colSf = event->GetSpreadingFactor ();
+      }
+  }
+};
 
-  // Add the event to the list
-  m_events.push_back (event);
+// The event survives if it's stronger than the strongest interferer using
+// the same SF by at least delta
+struct PowerLevelPolicy
+{
+  static const bool crossSf = false;
+
+  static void
+  Decide (const LoraInterferenceHelper &helper,
+          Ptr<LoraInterferenceHelper::Event> event,
+          LoraInterferenceHelper::Result &result)
+  {
+    double rxPowerDbm = event->GetRxPowerdBm ();
+    double eventDelta = abs (rxPowerDbm - result.maxInterferencePowerDbm);
+    result.destroyed = !(eventDelta >= double(helper.GetDelta ()) &&
+                         rxPowerDbm > result.maxInterferencePowerDbm);
+    if (result.destroyed)
+      {
+        result.colSf = event->GetSpreadingFactor ();
+      }
+  }
+};
+
+// The event survives if its energy exceeds the cumulative energy of the
+// interferers using the same SF by at least delta
+struct CumulEnergyPolicy
+{
+  static const bool crossSf = false;
+
+  static void
+  Decide (const LoraInterferenceHelper &helper,
+          Ptr<LoraInterferenceHelper::Event> event,
+          LoraInterferenceHelper::Result &result)
+  {
+    uint8_t sf = event->GetSpreadingFactor ();
+    result.destroyed = (result.signalEnergy < helper.GetDeltaLinear () *
+                        result.interferenceEnergy[unsigned(sf)-7]);
+    if (result.destroyed)
+      {
+        result.colSf = sf;
+      }
+  }
+};
 
-  // Clean the event list
-  if (m_events.size () > 1100)
+// Compare the signal energy with the interference energy of each of the six
+// SFs, weighted by the isolation, and return a mask with bit i set if SF 7+i
+// destroys the signal. This is a fixed-size, allocation-free scalar kernel:
+// the loop has a fixed trip count and no branches, but it is too short for
+// the compiler to vectorize it.
+static inline uint32_t
+CochannelKernel (double signalEnergy, const double energy[6],
+                 const double isolation[6])
+{
+  uint32_t mask = 0;
+  for (unsigned i = 0; i < 6; i++)
     {
-      CleanOldEvents ();
+      mask |= uint32_t (signalEnergy < isolation[i] * energy[i]) << i;
     }
+  return mask;
+}
 
-  return event;
+// The event survives if its energy exceeds the interference energy of each SF
+// by the margin given by the co-channel rejection matrix, or thanks to
+// capture effect
+struct CochannelPolicy
+{
+  static const bool crossSf = true;
+
+  static void
+  Decide (const LoraInterferenceHelper &helper,
+          Ptr<LoraInterferenceHelper::Event> event,
+          LoraInterferenceHelper::Result &result)
+  {
+    uint8_t sf = event->GetSpreadingFactor ();
+
+    // For each SF, check if there was destructive interference
+    uint32_t destroyingSfs = CochannelKernel (result.signalEnergy,
+                                              result.interferenceEnergy,
+                                              LoraInterferenceHelper::GetIsolationRow (sf));
+
+    if (destroyingSfs != 0)
+      {
+        // Report the highest SF that destroyed the packet
+        for (uint8_t currentSf = uint8_t (7); currentSf <= uint8_t (12); currentSf++)
+          {
+            if (destroyingSfs & (1u << (currentSf - 7)))
+              {
+                NS_LOG_DEBUG ("Packet destroyed by interference with SF" <<
+                              unsigned(currentSf));
+                result.colSf = currentSf;
+              }
+          }
+        result.destroyed = true;
+      }
+
+    // Check if packet survives due to capture effect:
+    // -- > The event starts before all the other interferer events
+    // -- > The preamble was not interferred, meaning that the GW does not loose the synchronization
+    // -- > The signal strength of the first event is bigger than the cumulative interference energy
+    if (result.nLaterInterferers == result.nInterferers &&
+        result.nPreambleInterferers == 0)
+      {
+        double isolation = LoraInterferenceHelper::GetIsolation (sf, sf);
+        if (result.signalEnergy >=
+            isolation * result.interferenceEnergy[unsigned(sf)-7])
+          {
+            result.destroyed = false;
+            result.colSf = 0;
+            result.captureEffect = true;
+          }
+      }
+  }
+};
+
+map<uint8_t, Ptr<const LoraInterferenceHelper::Model> > &
+LoraInterferenceHelper::GetModelRegistry (void)
+{
+  static map<uint8_t, Ptr<const LoraInterferenceHelper::Model> > registry;
+  if (registry.empty ())
+    {
+      registry[1] = Create<PolicyModel<PureAlohaPolicy> > ();
+      registry[2] = Create<PolicyModel<PowerLevelPolicy> > ();
+      registry[3] = Create<PolicyModel<CumulEnergyPolicy> > ();
+      registry[4] = Create<PolicyModel<CochannelPolicy> > ();
+    }
+
+  return registry;
 }
 
 void
-LoraInterferenceHelper::SetInterferenceModel(Int_Model model)
+LoraInterferenceHelper::RegisterModel (uint8_t id,
+                                       Ptr<const LoraInterferenceHelper::Model>
+                                       model)
 {
-	//NS_LOG_FUNCTION (this);
-	m_intmodel = model;
-	//NS_LOG_INFO ("Interferece model: " << m_intmodel);
+  NS_ASSERT (model != 0);
 
+  GetModelRegistry ()[id] = model;
 }
 
-LoraInterferenceHelper::Int_Model
-LoraInterferenceHelper::GetInterferenceModel(void)
+Ptr<const LoraInterferenceHelper::Model>
+LoraInterferenceHelper::LookupModel (uint8_t id)
 {
-	//NS_LOG_FUNCTION (this);
-	return m_intmodel;
+  map<uint8_t, Ptr<const LoraInterferenceHelper::Model> > &registry =
+    GetModelRegistry ();
+
+  map<uint8_t, Ptr<const LoraInterferenceHelper::Model> >::const_iterator it =
+    registry.find (id);
+
+  if (it == registry.end ())
+    {
+      return 0;
+    }
+
+  return it->second;
 }
 
-void LoraInterferenceHelper::SetDelta (double delta)
+void
+LoraInterferenceHelper::SetModel (Ptr<const LoraInterferenceHelper::Model>
+                                  model)
 {
-  //NS_LOG_FUNCTION (this);
-  m_delta = delta;
-  NS_LOG_INFO ("delta: " << m_delta);
+  NS_ASSERT (model != 0);
 
+  m_model = model;
 }
 
-uint8_t LoraInterferenceHelper::GetDelta (void)
+Ptr<const LoraInterferenceHelper::Model>
+LoraInterferenceHelper::GetModel (void) const
 {
-  //NS_LOG_FUNCTION (this);
-  return m_delta;
+  return m_model;
+}
 
+double
+LoraInterferenceHelper::GetIsolation (uint8_t sf, uint8_t interfererSf)
+{
+  return collisionSnirLinear[unsigned(sf)-7][unsigned(interfererSf)-7];
 }
 
-void
-LoraInterferenceHelper::CleanOldEvents (void)
+const double *
+LoraInterferenceHelper::GetIsolationRow (uint8_t sf)
 {
-  //NS_LOG_FUNCTION (this);
+  return collisionSnirLinear[unsigned(sf)-7];
+}
+
+double
+LoraInterferenceHelper::GetMaxIsolationDb (void)
+{
+  return *max_element (&collisionSnir[0][0], &collisionSnir[0][0] + 36);
+}
+
+Ptr<LoraInterferenceHelper::Event>
+LoraInterferenceHelper::Add (Time duration, double rxPower,
+                             uint8_t spreadingFactor, Ptr<Packet> packet,
+                             double frequencyMHz)
+{
+
+  //NS_LOG_FUNCTION (this << duration.GetSeconds () << rxPower << unsigned
+  //                 (spreadingFactor) << packet << frequencyMHz << m_intmodel << Simulator::Now ().GetSeconds ());
+
+  // Describe a transmission that is only heard by this device
+  Ptr<LoraInterferenceHelper::Transmission> transmission =
+    Create<LoraInterferenceHelper::Transmission> (duration, spreadingFactor,
+                                                  packet, frequencyMHz);
+
+  return Add (transmission, rxPower);
+}
+
+Ptr<LoraInterferenceHelper::Event>
+LoraInterferenceHelper::Add (Ptr<const LoraInterferenceHelper::Transmission>
+                             transmission, double rxPower)
+{
+  // Create an event based on the parameters
+  Ptr<LoraInterferenceHelper::Event> event =
+    Create<LoraInterferenceHelper::Event> (transmission, rxPower);
+
+  // Remember the background noise so far, to get the part overlapping with
+  // the event when it is evaluated
+  if (!m_background.empty ())
+    {
+      event->SetBackgroundEnergyAtStart
+        (GetBackgroundEnergy (transmission->GetFrequency ()));
+    }
+
+  // Retire the events that can no longer interfere with anything
+  CleanOldEvents ();
 
-  // Cycle the events, and clean up if an event is old.
-  for (auto it = m_events.begin (); it != m_events.end ();)
+  // Add the event to the bucket of its frequency and spreading factor
+  EventBucket &bucket = GetBucket (transmission->GetFrequency (),
+                                   transmission->GetSpreadingFactor ());
+  bucket.Insert (event);
+
+  ExpiryEntry entry;
+  entry.bucket = &bucket;
+  entry.endTick = event->GetEndTick ();
+  m_expiryQueue.push_back (entry);
+
+  m_nEvents++;
+  if (m_nEvents > m_highWaterMark)
     {
-      if ((*it)->GetEndTime () + oldEventThreshold < Simulator::Now ())
+      m_highWaterMark = m_nEvents;
+      if (!m_highWaterCallback.IsNull ())
         {
-          it = m_events.erase (it);
+          m_highWaterCallback (m_highWaterMark);
         }
-      it++;
     }
+
+  return event;
 }
 
-list<Ptr<LoraInterferenceHelper::Event> >
-LoraInterferenceHelper::GetInterferers ()
+LoraInterferenceHelper::BackgroundNoise::BackgroundNoise () :
+  powerW (0),
+  lastTick (0),
+  energy (0)
 {
-  return m_events;
 }
 
 void
-LoraInterferenceHelper::PrintEvents (ostream &stream)
+LoraInterferenceHelper::Advance (BackgroundNoise &noise, int64_t tick)
 {
-  //NS_LOG_FUNCTION_NOARGS ();
-
-  stream << "Currently registered events:" << endl;
+  while (!noise.ends.empty () && noise.ends.top ().first <= tick)
+    {
+      noise.energy += noise.powerW * (noise.ends.top ().first - noise.lastTick);
+      noise.lastTick = noise.ends.top ().first;
+      noise.powerW -= noise.ends.top ().second;
+      noise.ends.pop ();
+    }
 
-  for (auto it = m_events.begin (); it != m_events.end (); it++)
+  // Do not let rounding errors leave some power behind
+  if (noise.ends.empty ())
     {
-      (*it)->Print (stream);
-      stream << endl;
+      noise.powerW = 0;
     }
+
+  noise.energy += noise.powerW * (tick - noise.lastTick);
+  noise.lastTick = tick;
 }
 
 double
-LoraInterferenceHelper::GetSINR
-  (Ptr<LoraInterferenceHelper::Event> event)
-{
-
-	 //NS_LOG_FUNCTION (this << event);
-	 //NS_LOG_INFO ("Current number of events in LoraInterferenceHelper: " << m_events.size ());
-	 //NS_LOG_INFO ("PowerCE Interferece model: " << GetInterferenceModel());
-
-	// We want to see the interference affecting this event: cycle through events
-	// that overlap with this one and see whether it survives the interference or
-	// not.
-
-	// Gather information about the event
-	uint8_t sf = event->GetSpreadingFactor ();
-	double frequency = event->GetFrequency ();
-	// Handy information about the time frame when the packet was received
-
-	Time now = Simulator::Now ();
-	Time duration = event->GetDuration ();
-	Time packetStartTime = now - duration;
-	Time packetEndTime = now;
-
-	// Get the list of interfering events
-	list<Ptr<LoraInterferenceHelper::Event> >::iterator it;
-
-	// Energy for interferers of various SFs
-	vector<double> cumulativeInterferenceEnergy (6,0);
-
-	// Energy of the event signal
-	double signalEnergy = 0;
-
-	// Get the Rx Power
-	double rxPowerDbm = event->GetRxPowerdBm ();
-	double delta = double(GetDelta());
-	//NS_LOG_INFO ("Delta: " << delta);
-
-	// Cycle over the events
-	for (it = m_events.begin (); it != m_events.end ();)
-	    {
-
-		 	 // Pointer to the current interferer
-		 	 Ptr< LoraInterferenceHelper::Event > interferer = *it;
-
-		 	 // Only consider the current event if the channel is the same: we
-		 	 // assume there's no interchannel interference. Also skip the current
-		 	 // event if it's the same that we want to analyze.
-
-		 	 if (interferer == event)
-		 	 {
-		 		 //NS_LOG_DEBUG ("Same event");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 if (!(interferer->GetFrequency () == frequency))
-		 	 {
-		 		 //NS_LOG_DEBUG ("Different channel");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 //NS_LOG_DEBUG ("Interferer on same channel");
-
-		 	 // Gather information about this interferer
-		 	 uint8_t interfererSf = interferer->GetSpreadingFactor ();
-		 	 Time interfererStartTime = interferer->GetStartTime ();
-		 	 Time interfererEndTime = interferer->GetEndTime ();
-		     double interfererPower = interferer->GetRxPowerdBm ();
-
-		 	 //NS_LOG_INFO ("Found an interferer: sf = " << unsigned(interfererSf)
-			//			 << ", start time = " << interfererStartTime
-			//			 << ", end time = " << interfererEndTime);
-
-		 	 // Compute the fraction of time the two events are overlapping
-		 	 Time overlap = GetOverlapTime (event, interferer);
-		 	 //NS_LOG_DEBUG ("The two events overlap for " << overlap.GetSeconds () << " s.");
-		 	 it++;
-
-		 	 if (overlap.GetSeconds () != 0) {
-
-			      // Compute the equivalent energy of the interference
-			      // Power [mW] = 10^(Power[dBm]/10)
-			      // Power [W] = Power [mW] / 1000
-			      double interfererPowerW = pow (10, interfererPower/10) / 1000;
-			      // Energy [J] = Time [s] * Power [W]
-			      double interferenceEnergy = overlap.GetSeconds () * interfererPowerW;
-			      cumulativeInterferenceEnergy.at (unsigned(interfererSf)-7) += interferenceEnergy;
-			      //NS_LOG_DEBUG ("Interferer power in W: " << interfererPowerW);
-			      //NS_LOG_DEBUG ("Interference energy: " << interferenceEnergy);
-		 	 	 }
+LoraInterferenceHelper::GetBackgroundEnergy (double frequencyMHz) const
+{
+  map<double, BackgroundNoise>::iterator it = m_background.find (frequencyMHz);
+  if (it == m_background.end ())
+    {
+      return 0;
+    }
 
+  Advance (it->second, Simulator::Now ().GetTimeStep ());
+  return it->second.energy;
+}
 
-	    }
+void
+LoraInterferenceHelper::AddBackground
+  (Ptr<const LoraInterferenceHelper::Transmission> transmission,
+  double rxPower)
+{
+  NS_LOG_FUNCTION (this << transmission << rxPower);
 
-    double signalPowerW = pow (10, rxPowerDbm/10) / 1000;
-    signalEnergy = signalPowerW*duration.GetSeconds ();
+  int64_t now = Simulator::Now ().GetTimeStep ();
+  double rxPowerW = pow (10, rxPower/10) / 1000;
 
-    double sigma = pow (10, -123/10) / 1000;
+  BackgroundNoise &noise = m_background[transmission->GetFrequency ()];
+  Advance (noise, now);
+  noise.powerW += rxPowerW;
+  noise.ends.push (std::make_pair
+                     (now + transmission->GetDuration ().GetTimeStep (),
+                     rxPowerW));
 
-	//NS_LOG_DEBUG ("signalEnergy " << signalEnergy << " [J]");
-	//NS_LOG_DEBUG ("cumulativeInterferenceEnergy " << cumulativeInterferenceEnergy.at (unsigned(sf)-7) << " [J]");
+  m_nBackgroundSignals++;
+}
 
-	double rssi = 10*log10((signalEnergy / (cumulativeInterferenceEnergy.at (unsigned(sf)-7) + sigma))); ///1000*duration.GetSeconds ()
+uint64_t
+LoraInterferenceHelper::GetNBackgroundSignals (void) const
+{
+  return m_nBackgroundSignals;
+}
 
-	return rssi;
+void
+LoraInterferenceHelper::SetInterferenceModel(Int_Model model)
+{
+	//NS_LOG_FUNCTION (this);
+	m_intmodel = model;
+	m_model = LookupModel (uint8_t (model) + 1);
+	//NS_LOG_INFO ("Interferece model: " << m_intmodel);
 
 }
 
-bool
-LoraInterferenceHelper::IsDestroyedByInterference
-  (Ptr<LoraInterferenceHelper::Event> event)
+LoraInterferenceHelper::Int_Model
+LoraInterferenceHelper::GetInterferenceModel(void) const
 {
-  //NS_LOG_FUNCTION (this << event << Simulator::Now ().GetSeconds ());
-
-  //NS_LOG_INFO ("Current number of events in LoraInterferenceHelper: " << m_events.size ());
-  //NS_LOG_INFO ("Interferece model: " << GetInterferenceModel());
+	//NS_LOG_FUNCTION (this);
+	return m_intmodel;
+}
 
-  bool interferred = false;
+void LoraInterferenceHelper::SetDelta (double delta)
+{
+  //NS_LOG_FUNCTION (this);
+  m_delta = delta;
+  m_deltaLinear = pow (10, double(GetDelta ())/10);
+  NS_LOG_INFO ("delta: " << m_delta);
 
-  Int_Model inter = GetInterferenceModel();
+}
 
+double
+LoraInterferenceHelper::GetDeltaLinear (void) const
+{
+  return m_deltaLinear;
+}
 
-  if (inter == Cochannel_Matrix) {
-	  interferred = Cochannel(event);
-  }
+uint8_t LoraInterferenceHelper::GetDelta (void) const
+{
+  //NS_LOG_FUNCTION (this);
+  return m_delta;
 
-  if (inter == CE_PowerLevel) {
-	  interferred = PowerLevel(event);
-  }
+}
 
-  if (inter == CE_CumulEnergy) {
-		  interferred = CumulEnergy(event);
-  }
+void
+LoraInterferenceHelper::CleanOldEvents (void)
+{
+  //NS_LOG_FUNCTION (this);
 
-  if (inter == Pure_ALOHA) {
-		  interferred = Aloha(event);
-  }
+  int64_t oldestEndTick = (Simulator::Now () - m_horizon).GetTimeStep ();
 
-  return interferred;
+  // An event that is still needed at the head of the queue holds back the
+  // ones added after it, but only until it ends: the queue never spans more
+  // than the horizon plus the longest event.
+  while (!m_expiryQueue.empty () &&
+         m_expiryQueue.front ().endTick < oldestEndTick)
+    {
+      m_expiryQueue.front ().bucket->PopFront ();
+      m_expiryQueue.pop_front ();
+      m_nEvents--;
+    }
 }
 
-bool
-LoraInterferenceHelper::Aloha
-  (Ptr<LoraInterferenceHelper::Event> event)
+void
+LoraInterferenceHelper::SetHorizon (Time horizon)
 {
+  m_horizon = horizon;
+}
 
- NS_LOG_FUNCTION (this << event);
- //NS_LOG_INFO ("Current number of events in LoraInterferenceHelper: " << m_events.size ());
- //NS_LOG_INFO ("Interferece model: " << GetInterferenceModel());
-
-// We want to see the interference affecting this event: cycle through events
-// that overlap with this one and see whether it survives the interference or
-// not.
+Time
+LoraInterferenceHelper::GetHorizon (void) const
+{
+  return m_horizon;
+}
 
-bool interferred = false;
+Time
+LoraInterferenceHelper::GetMaxOnAirTime (void)
+{
+  // The longest frame uses SF12, the 4/8 coding rate, an explicit header and
+  // the largest payload a LoRa modem supports
+  static Time maxOnAirTime;
+  if (maxOnAirTime.IsZero ())
+    {
+      LoraTxParameters txParams;
+      txParams.sf = 12;
+      txParams.headerDisabled = false;
+      txParams.codingRate = 4;
+      txParams.bandwidthHz = 125000;
+      txParams.crcEnabled = true;
+      txParams.lowDataRateOptimizationEnabled = true;
+      maxOnAirTime = LoraPhy::GetOnAirTime (Create<Packet> (255), txParams);
+    }
 
-// Gather information about the event
-uint8_t sf = event->GetSpreadingFactor ();
-double frequency = event->GetFrequency ();
-// Handy information about the time frame when the packet was received
+  return maxOnAirTime;
+}
 
-Time now = Simulator::Now ();
-Time duration = event->GetDuration ();
-Time packetStartTime = now - duration;
-Time packetEndTime = now;
+uint32_t
+LoraInterferenceHelper::GetHighWaterMark (void) const
+{
+  return m_highWaterMark;
+}
 
-// Get the list of interfering events
-list<Ptr<LoraInterferenceHelper::Event> >::iterator it;
+void
+LoraInterferenceHelper::SetHighWaterCallback (Callback<void, uint32_t> callback)
+{
+  m_highWaterCallback = callback;
+}
 
+LoraInterferenceHelper::EventBucket &
+LoraInterferenceHelper::GetBucket (double frequencyMHz, uint8_t spreadingFactor)
+{
+  NS_ASSERT (spreadingFactor >= 7 && spreadingFactor <= 12);
 
-// Cycle over the events
-for (it = m_events.begin (); it != m_events.end ();)
+  // The vector is never resized again, so that m_expiryQueue can safely
+  // point to its buckets
+  vector<EventBucket> &buckets = m_buckets[frequencyMHz];
+  if (buckets.empty ())
     {
+      buckets.resize (6);
+    }
 
-	 	 // Pointer to the current interferer
-	 	 Ptr< LoraInterferenceHelper::Event > interferer = *it;
+  return buckets[unsigned(spreadingFactor)-7];
+}
 
-	 	 // Only consider the current event if the channel is the same: we
-	 	 // assume there's no interchannel interference. Also skip the current
-	 	 // event if it's the same that we want to analyze.
+const LoraInterferenceHelper::EventBucket *
+LoraInterferenceHelper::FindBucket (double frequencyMHz,
+                                    uint8_t spreadingFactor) const
+{
+  map<double, vector<EventBucket> >::const_iterator buckets =
+    m_buckets.find (frequencyMHz);
 
-	 	 if (!(interferer->GetFrequency () == frequency) || !(interferer->GetSpreadingFactor () == sf) || interferer == event)
-	 	 {
-	 		 //NS_LOG_DEBUG ("Different channel");
-	 		 it++;
-	 		 continue;   // Continues from the first line inside the for cycle
-	 	 }
+  if (buckets == m_buckets.end () || buckets->second.empty ())
+    {
+      return 0;
+    }
 
-	 	 //if (!(interferer->GetSpreadingFactor () == sf) || interferer == event)
-	 	 //{
-	 		 //NS_LOG_DEBUG ("Different sf");
-	 	//	 it++;
-	 	//	 continue;   // Continues from the first line inside the for cycle
-	 	 //}
+  return &buckets->second[unsigned(spreadingFactor)-7];
+}
 
-	 	 //NS_LOG_DEBUG ("Interferer on same channel and sf");
+list<Ptr<LoraInterferenceHelper::Event> >
+LoraInterferenceHelper::GetInterferers ()
+{
+  list<Ptr<LoraInterferenceHelper::Event> > interferers;
 
-	 	 // Gather information about this interferer
-	 	 uint8_t interfererSf = interferer->GetSpreadingFactor ();
-	 	 Time interfererStartTime = interferer->GetStartTime ();
-	 	 Time interfererEndTime = interferer->GetEndTime ();
+  for (auto freq = m_buckets.begin (); freq != m_buckets.end (); freq++)
+    {
+      for (auto bucket = freq->second.begin (); bucket != freq->second.end ();
+           bucket++)
+        {
+          for (uint32_t i = bucket->Begin (); i != bucket->End (); i++)
+            {
+              interferers.push_back
+                (Create<LoraInterferenceHelper::Event> (bucket->GetTransmission (i),
+                                                        bucket->GetRxPowerdBm (i),
+                                                        bucket->GetStartTick (i),
+                                                        bucket->GetEndTick (i)));
+            }
+        }
+    }
 
-	 	 //NS_LOG_INFO ("Found an interferer: sf = " << unsigned(interfererSf)
-			//		 << ", start time = " << interfererStartTime
-		//			 << ", end time = " << interfererEndTime);
+  return interferers;
+}
 
-	 	 // Compute the fraction of time the two events are overlapping
-	 	 Time overlap = GetOverlapTime (event, interferer);
-	 	 //NS_LOG_DEBUG ("The two events overlap for " << overlap.GetSeconds () << " s.");
+void
+LoraInterferenceHelper::PrintEvents (ostream &stream)
+{
+  //NS_LOG_FUNCTION_NOARGS ();
 
-	 	 it++;
+  stream << "Currently registered events:" << endl;
 
-	 	 if (overlap.GetSeconds () != 0) {
-	 		 interferred = true;
+  list<Ptr<LoraInterferenceHelper::Event> > events = GetInterferers ();
 
-	     }
+  for (auto it = events.begin (); it != events.end (); it++)
+    {
+      (*it)->Print (stream);
+      stream << endl;
     }
-
-	return interferred;
-
 }
 
-bool
-LoraInterferenceHelper::CumulEnergy
-  (Ptr<LoraInterferenceHelper::Event> event)
-{
-
-	 NS_LOG_FUNCTION (this << event);
-	 //NS_LOG_INFO ("Current number of events in LoraInterferenceHelper: " << m_events.size ());
-	 //NS_LOG_INFO ("PowerCE Interferece model: " << GetInterferenceModel());
-
-	// We want to see the interference affecting this event: cycle through events
-	// that overlap with this one and see whether it survives the interference or
-	// not.
-
-	bool interferred = false;
-
-	// Gather information about the event
-	uint8_t sf = event->GetSpreadingFactor ();
-	double frequency = event->GetFrequency ();
-	// Handy information about the time frame when the packet was received
-
-	Time now = Simulator::Now ();
-	Time duration = event->GetDuration ();
-	Time packetStartTime = now - duration;
-	Time packetEndTime = now;
-
-	// Get the list of interfering events
-	list<Ptr<LoraInterferenceHelper::Event> >::iterator it;
-
-	// Energy for interferers of various SFs
-	vector<double> cumulativeInterferenceEnergy (6,0);
-
-	// Energy of the event signal
-	double signalEnergy = 0;
-
-	// Get the Rx Power
-	double rxPowerDbm = event->GetRxPowerdBm ();
-	double delta = double(GetDelta());
-	//NS_LOG_INFO ("Delta: " << delta);
-
-	// Cycle over the events
-	for (it = m_events.begin (); it != m_events.end ();)
-	    {
-
-		 	 // Pointer to the current interferer
-		 	 Ptr< LoraInterferenceHelper::Event > interferer = *it;
-
-		 	 // Only consider the current event if the channel is the same: we
-		 	 // assume there's no interchannel interference. Also skip the current
-		 	 // event if it's the same that we want to analyze.
-
-		 	 if (interferer == event)
-		 	 {
-		 		 //NS_LOG_DEBUG ("Same event");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 if (!(interferer->GetFrequency () == frequency))
-		 	 {
-		 		 //NS_LOG_DEBUG ("Different channel");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 if (!(interferer->GetSpreadingFactor () == sf))
-		 	 {
-		 		 //NS_LOG_DEBUG ("Different sf");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 //NS_LOG_DEBUG ("Interferer on same channel and sf");
-
-		 	 // Gather information about this interferer
-		 	 uint8_t interfererSf = interferer->GetSpreadingFactor ();
-		 	 Time interfererStartTime = interferer->GetStartTime ();
-		 	 Time interfererEndTime = interferer->GetEndTime ();
-		     double interfererPower = interferer->GetRxPowerdBm ();
-
-		 	 //NS_LOG_INFO ("Found an interferer: sf = " << unsigned(interfererSf)
-			///			 << ", start time = " << interfererStartTime
-			//			 << ", end time = " << interfererEndTime);
-
-		 	 // Compute the fraction of time the two events are overlapping
-		 	 Time overlap = GetOverlapTime (event, interferer);
-		 	 //NS_LOG_DEBUG ("The two events overlap for " << overlap.GetSeconds () << " s.");
-		 	 it++;
-
-		 	 if (overlap.GetSeconds () != 0) {
-
-			      // Compute the equivalent energy of the interference
-			      // Power [mW] = 10^(Power[dBm]/10)
-			      // Power [W] = Power [mW] / 1000
-			      double interfererPowerW = pow (10, interfererPower/10) / 1000;
-			      // Energy [J] = Time [s] * Power [W]
-			      double interferenceEnergy = overlap.GetSeconds () * interfererPowerW;
-			      cumulativeInterferenceEnergy.at (unsigned(interfererSf)-7) += interferenceEnergy;
-			      //NS_LOG_DEBUG ("Interferer power in W: " << interfererPowerW);
-			      //NS_LOG_DEBUG ("Interference energy: " << interferenceEnergy);
-		 	 	 }
+template <bool crossSf>
+LoraInterferenceHelper::Result
+LoraInterferenceHelper::Scan (Ptr<LoraInterferenceHelper::Event> event) const
+{
+  NS_LOG_FUNCTION (this << event);
+
+  // We want to see the interference affecting this event: cycle through events
+  // that overlap with this one and collect what the models need to decide
+  // whether it survives the interference or not.
+
+  Result result;
+  result.destroyed = false;
+  result.sinr = 0;
+  fill (result.interferenceEnergy, result.interferenceEnergy + 6, 0);
+  result.colSf = 0;
+  result.colStart = Seconds (0);
+  result.colEnd = Seconds (0);
+  result.onThePreamble = false;
+  result.captureEffect = false;
+  result.nInterferers = 0;
+  result.nLaterInterferers = 0;
+  result.nPreambleInterferers = 0;
+  result.signalEnergy = 0;
+  result.maxInterferencePowerDbm = -1000;
+
+  // Gather information about the event
+  uint8_t sf = event->GetSpreadingFactor ();
+  double frequency = event->GetFrequency ();
+  int64_t startTick = event->GetStartTick ();
+  int64_t endTick = event->GetEndTick ();
+
+  // Energies are accumulated in W * time steps, and only converted to J at
+  // the end
+  double interferenceEnergy[6] = {0, 0, 0, 0, 0, 0};
+
+  // The preamble of the event, to check whether interferers overlap with it
+  int64_t preambleTicks =
+    event->GetTransmission ()->GetPreamble ().GetTimeStep ();
+
+  // Counters used to check whether the event survives thanks to capture
+  // effect: interferers starting after the event, and interferers hitting its
+  // preamble
+  uint32_t firstCounter = 0;
+  uint32_t preambleCounter = 0;
+
+  // Power of the strongest interferer using the same SF
+  double maxInterferenceLevel = -1000;
+
+  // Start of the overlapping interferer that started last, and the
+  // corresponding collision interval
+  int64_t latestStartTick = numeric_limits<int64_t>::min ();
+  int64_t colStartTick = 0;
+  int64_t colEndTick = 0;
+
+  // We assume there's no interchannel interference.
+  uint8_t firstSf = crossSf ? uint8_t (7) : sf;
+  uint8_t lastSf = crossSf ? uint8_t (12) : sf;
+
+  // Look the frequency up once for all the SFs
+  const EventBucket *buckets = FindBucket (frequency, 7);
+
+  for (uint8_t currentSf = firstSf; currentSf <= lastSf && buckets != 0;
+       currentSf++)
+    {
+      const EventBucket *bucket = buckets + (unsigned(currentSf)-7);
 
+      uint32_t last = bucket->OverlapEnd (endTick);
 
-	    }
+      // Accumulate this SF's energy in a local, so that the compiler can keep
+      // it in a register
+      double energy = 0;
 
-    double signalPowerW = pow (10, rxPowerDbm/10) / 1000;
-    signalEnergy = duration.GetSeconds () * signalPowerW;
+      for (uint32_t i = bucket->OverlapBegin (startTick); i != last; i++)
+        {
+          int64_t interfererStartTick = bucket->GetStartTick (i);
+          int64_t interfererEndTick = bucket->GetEndTick (i);
+
+          // Compute the number of time steps the two events are overlapping
+          int64_t overlap = min (endTick, interfererEndTick) -
+            max (startTick, interfererStartTick);
+
+          // The current event is not an interferer of itself
+          bool interferes = overlap > 0 &&
+            bucket->GetTransmission (i) != event->GetTransmission ();
+
+          // Compute the equivalent energy of the interference without a
+          // branch: the events that do not interfere add zero, which leaves
+          // the sum unchanged. The sum keeps its order, so it is not
+          // vectorized, but it does not depend on branch prediction.
+          energy += double (overlap) * double (interferes) *
+            bucket->GetRxPowerW (i);
+
+          if (!interferes)
+            {
+              continue;
+            }
+
+          result.nInterferers++;
+
+          if (currentSf == sf)
+            {
+              maxInterferenceLevel =
+                max (bucket->GetRxPowerdBm (i),
+                     maxInterferenceLevel);
+            }
+
+          bool onThePreamble = OnThePreamble (startTick, endTick,
+                                              preambleTicks,
+                                              interfererStartTick);
+          if (onThePreamble)
+            {
+              preambleCounter++;
+            }
+
+          if (startTick < interfererStartTick)
+            {
+              firstCounter++;
+            }
+
+          // Report the collision with the interferer that started last
+          if (interfererStartTick >= latestStartTick)
+            {
+              latestStartTick = interfererStartTick;
+              colStartTick = max (startTick, interfererStartTick);
+              colEndTick = min (endTick, interfererEndTick);
+              result.onThePreamble = onThePreamble;
+            }
+        }
 
-	//NS_LOG_DEBUG ("signalEnergy " << signalEnergy << " dB");
-	//NS_LOG_DEBUG ("cumulativeInterferenceEnergy " << cumulativeInterferenceEnergy.at (unsigned(sf)-7) << " dB");
+      interferenceEnergy[unsigned(currentSf)-7] = energy;
+    }
 
-	double snir = 10*log10 (signalEnergy/cumulativeInterferenceEnergy.at (unsigned(sf)-7));
-	//NS_LOG_DEBUG ("The current SNIR is " << snir << " dB");
+  result.colStart = TimeStep (colStartTick);
+  result.colEnd = TimeStep (colEndTick);
 
-	if (snir >= delta)
-	{
-		// Move on and check the rest of the interferers
-		//NS_LOG_DEBUG ("Packet survived interference");
-		//NS_LOG_DEBUG ("RX Power " << rxPowerDbm << " SNIR " << snir);
-		interferred = false;
-		}
-	else
-	{
-		//NS_LOG_DEBUG ("Packet destroyed by interference with SF" <<	unsigned(sf));
-        interferred = true;
-	}
+  // The background noise that accumulated since the event started, which is
+  // only negative if the events were cleared in the meantime. The SF of the
+  // pruned signals is not kept, so it counts as interference from the
+  // event's own SF, which the co-channel rejection matrix isolates the least:
+  // the models then decide as if the signals had not been pruned, or more
+  // pessimistically.
+  if (!m_background.empty ())
+    {
+      interferenceEnergy[unsigned(sf)-7] +=
+        max (0.0, GetBackgroundEnergy (frequency) -
+             event->GetBackgroundEnergyAtStart ());
+    }
 
-	return interferred;
+  // Energy of the event signal
+  double signalEnergy = (endTick - startTick) * event->GetRxPowerW ();
+  double sameSfEnergy = interferenceEnergy[unsigned(sf)-7];
 
+  // Energy [J] = Time [s] * Power [W]
+  double stepSeconds = TimeStep (1).GetSeconds ();
+  for (unsigned i = 0; i < 6; i++)
+    {
+      result.interferenceEnergy[i] = interferenceEnergy[i] * stepSeconds;
+    }
 
-}
+  double sigma = pow (10, -123/10) / 1000;
+  result.sinr = 10*log10 (signalEnergy * stepSeconds /
+                          (sameSfEnergy * stepSeconds + sigma));
 
-bool
-LoraInterferenceHelper::PowerLevel
-  (Ptr<LoraInterferenceHelper::Event> event)
-{
-
-	 NS_LOG_FUNCTION (this << event);
-	 //NS_LOG_INFO ("Current number of events in LoraInterferenceHelper: " << m_events.size ());
-	 //NS_LOG_INFO ("PowerCE Interferece mode - level: " << GetInterferenceModel());
-
-	// We want to see the interference affecting this event: cycle through events
-	// that overlap with this one and see whether it survives the interference or
-	// not.
-
-	bool interferred = false;
-
-	// Gather information about the event
-	uint8_t sf = event->GetSpreadingFactor ();
-	double frequency = event->GetFrequency ();
-	// Handy information about the time frame when the packet was received
-
-	Time now = Simulator::Now ();
-	Time duration = event->GetDuration ();
-	Time packetStartTime = now - duration;
-	Time packetEndTime = now;
-
-	// Get the list of interfering events
-	list<Ptr<LoraInterferenceHelper::Event> >::iterator it;
-
-	// Energy for interferers of various SFs
-	double MaxInterferenceLevel = -1000;
-
-	// Get the Rx Power
-	double rxPowerDbm = event->GetRxPowerdBm ();
-	double delta = double(GetDelta());
-	//NS_LOG_INFO ("Delta: " << delta);
-
-	// Cycle over the events
-	for (it = m_events.begin (); it != m_events.end ();)
-	    {
-
-		 	 // Pointer to the current interferer
-		 	 Ptr< LoraInterferenceHelper::Event > interferer = *it;
-
-		 	 // Only consider the current event if the channel is the same: we
-		 	 // assume there's no interchannel interference. Also skip the current
-		 	 // event if it's the same that we want to analyze.
-
-		 	 if (interferer == event)
-		 	 {
-		 		 //NS_LOG_DEBUG ("Same event");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 if (!(interferer->GetFrequency () == frequency))
-		 	 {
-		 		 //NS_LOG_DEBUG ("Different channel");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 if (!(interferer->GetSpreadingFactor () == sf))
-		 	 {
-		 		 //NS_LOG_DEBUG ("Different sf");
-		 		 it++;
-		 		 continue;   // Continues from the first line inside the for cycle
-		 	 }
-
-		 	 //NS_LOG_DEBUG ("Interferer on same channel and sf");
-
-		 	 // Gather information about this interferer
-		 	 uint8_t interfererSf = interferer->GetSpreadingFactor ();
-		 	 Time interfererStartTime = interferer->GetStartTime ();
-		 	 Time interfererEndTime = interferer->GetEndTime ();
-		     double interfererPower = interferer->GetRxPowerdBm ();
-
-		 	 //NS_LOG_INFO ("Found an interferer: sf = " << unsigned(interfererSf)
-			//			 << ", start time = " << interfererStartTime.GetSeconds()
-			//			 << ", end time = " << interfererEndTime.GetSeconds());
-
-		 	 // Compute the fraction of time the two events are overlapping
-		 	 Time overlap = GetOverlapTime (event, interferer);
-		 	 //NS_LOG_DEBUG ("The two events overlap for " << overlap.GetSeconds () << " s.");
-		 	 it++;
-
-		 	 if (overlap.GetSeconds () != 0) {
-
-			      MaxInterferenceLevel = max (interfererPower,MaxInterferenceLevel);
-			      //NS_LOG_DEBUG ("Interferer power: " << interfererPower);
-		 	 	 }
-	    }
+  result.signalEnergy = signalEnergy * stepSeconds;
+  result.maxInterferencePowerDbm = maxInterferenceLevel;
+  result.nLaterInterferers = firstCounter;
+  result.nPreambleInterferers = preambleCounter;
 
-	double event_delta = abs(rxPowerDbm - MaxInterferenceLevel);
-	//NS_LOG_DEBUG ("The event delta in dBm is: " << event_delta << " dB");
+  return result;
+}
 
-	if (event_delta >= delta && rxPowerDbm > MaxInterferenceLevel)
+template LoraInterferenceHelper::Result
+LoraInterferenceHelper::Scan<false> (Ptr<LoraInterferenceHelper::Event> event) const;
+template LoraInterferenceHelper::Result
+LoraInterferenceHelper::Scan<true> (Ptr<LoraInterferenceHelper::Event> event) const;
 
-	{
-		// Move on and check the rest of the interferers
-		//NS_LOG_DEBUG ("Packet survived interference");
-		//NS_LOG_DEBUG ("RX Power " << rxPowerDbm << " Event delta " << event_delta);
-		interferred = false;
-		}
-	else
-	{
-		//NS_LOG_DEBUG ("Packet destroyed by interference with SF" <<
-		//unsigned(sf));
-        interferred = true;
-	}
+LoraInterferenceHelper::Result
+LoraInterferenceHelper::Evaluate (Ptr<LoraInterferenceHelper::Event> event) const
+{
+  NS_LOG_FUNCTION (this << event);
 
-	MaxInterferenceLevel = -1000;
-	event_delta = 0;
+  Result result = m_model->Evaluate (*this, event);
 
-	return interferred;
+  NS_LOG_DEBUG ("Interferers: " << result.nInterferers << ", SINR: " <<
+                result.sinr << " dB, destroyed: " << result.destroyed);
 
+  return result;
 }
 
 bool
-LoraInterferenceHelper::Cochannel
-  (Ptr<LoraInterferenceHelper::Event> event)
-{
-	  NS_LOG_FUNCTION (this << event);
-
-	  //NS_LOG_INFO ("Current number of events in LoraInterferenceHelper: " << m_events.size ());
-	  //NS_LOG_INFO ("Interferece model: " << GetInterferenceModel());
-
-
-	  // We want to see the interference affecting this event: cycle through events
-	  // that overlap with this one and see whether it survives the interference or
-	  // not.
-
-	  int first_counter = 0;
-	  int interferer_counter = 0;
-	  int preamble_counter = 0;
-	  bool interferred = false;
-
-	  // Gather information about the event
-	  double rxPowerDbm = event->GetRxPowerdBm ();
-	  uint8_t sf = event->GetSpreadingFactor ();
-	  double frequency = event->GetFrequency ();
-
-	  // Handy information about the time frame when the packet was received
-	  Time now = Simulator::Now ();
-	  Time duration = event->GetDuration ();
-	  Time packetStartTime = now - duration;
-	  Time packetEndTime = now;
-
-	  // Get the list of interfering events
-	  list<Ptr<LoraInterferenceHelper::Event> >::iterator it;
-
-	  // Energy for interferers of various SFs
-	  vector<double> cumulativeInterferenceEnergy (6,0);
-
-	  // Energy of the event signal
-	  double signalEnergy = 0;
-
-	  // Cycle over the events
-	  for (it = m_events.begin (); it != m_events.end ();)
-	    {
-	      // Pointer to the current interferer
-	      Ptr< LoraInterferenceHelper::Event > interferer = *it;
-
-	      // Only consider the current event if the channel is the same: we
-	      // assume there's no interchannel interference. Also skip the current
-	      // event if it's the same that we want to analyze.
-
-	      if (!(interferer->GetFrequency () == frequency) || interferer == event)
-	        {
-	          //NS_LOG_DEBUG ("Different channel");
-	          it++;
-	          continue;   // Continues from the first line inside the for cycle
-	        }
-
-	      //NS_LOG_DEBUG ("Interferer on same channel");
-
-	      // Gather information about this interferer
-	      uint8_t interfererSf = interferer->GetSpreadingFactor ();
-	      double interfererPower = interferer->GetRxPowerdBm ();
-	      Time interfererStartTime = interferer->GetStartTime ();
-	      Time interfererEndTime = interferer->GetEndTime ();
-
-	      //NS_LOG_INFO ("Found an interferer: sf = " << unsigned(interfererSf)
-	      //                                          << ", power = " << interfererPower
-	      //                                          << ", start time = " << interfererStartTime
-	      //                                          << ", end time = " << interfererEndTime);
-
-	      // Compute the fraction of time the two events are overlapping
-	      Time overlap = GetOverlapTime (event, interferer);
-	      //NS_LOG_DEBUG ("The two events overlap for " << overlap.GetSeconds () << " s.");
-
-	      if (overlap.GetSeconds () != 0) {
-	    	  interferer_counter++;
-
-	          bool onthepreamble = OnThePreamble (event, interferer);
-	          m_onthepreamble = onthepreamble;
-	          //NS_LOG_DEBUG ("Overlapped event on the preamble ? " << onthepreamble);
-	          if (m_onthepreamble == true) {
-	        	  preamble_counter++;
-	          }
-
-	          bool first =  GetFirst (event, interferer);
-	          //NS_LOG_DEBUG ("First ? " << first);
-
-	          if (first == true) {
-	        	  first_counter++;
-	          }
-	      }
-
-	      // Compute the equivalent energy of the interference
-	      // Power [mW] = 10^(Power[dBm]/10)
-	      // Power [W] = Power [mW] / 1000
-	      double interfererPowerW = pow (10, interfererPower/10) / 1000;
-	      // Energy [J] = Time [s] * Power [W]
-	      double interferenceEnergy = overlap.GetSeconds () * interfererPowerW;
-	      cumulativeInterferenceEnergy.at (unsigned(interfererSf)-7) += interferenceEnergy;
-	      //NS_LOG_DEBUG ("Interferer power in W: " << interfererPowerW);
-	      //NS_LOG_DEBUG ("Interference energy: " << interferenceEnergy);
-	      it++;
-	    }
-
-	  // For each SF, check if there was destructive interference
-	  for (uint8_t currentSf = uint8_t (7); currentSf <= uint8_t (12); currentSf++)
-	    {
-	      //NS_LOG_DEBUG ("Cumulative Interference Energy: " <<
-	       //             cumulativeInterferenceEnergy.at (unsigned(currentSf)-7));
-
-	      // Use the computed cumulativeInterferenceEnergy to determine whether the
-	      // interference with this SF destroys the packet
-	      double signalPowerW = pow (10, rxPowerDbm/10) / 1000;
-	      signalEnergy = duration.GetSeconds () * signalPowerW;
-	      //NS_LOG_DEBUG ("Signal power in W: " << signalPowerW);
-	      //NS_LOG_DEBUG ("Signal energy: " << cumulativeInterferenceEnergy.at (unsigned(currentSf)-7));
-
-	      // Check whether the packet survives the interference of this SF
-	      double snirIsolation = collisionSnir [unsigned(sf)-7][unsigned(currentSf)-7];
-	      //NS_LOG_DEBUG ("The needed isolation to survive is " << snirIsolation << " dB");
-
-	      double snir = 10*log10 (signalEnergy/cumulativeInterferenceEnergy.at (unsigned(currentSf)-7));
-	      //NS_LOG_DEBUG ("The current SNIR is " << snir << " dB");
-
-	      if (snir >= snirIsolation)
-	        {
-	          // Move on and check the rest of the interferers
-	          //NS_LOG_DEBUG ("Packet survived interference");
-	          //NS_LOG_DEBUG ("RX Power " << rxPowerDbm << " SNIR " << snir);
-	        }
-	      else
-	        {
-	          //NS_LOG_DEBUG ("Packet destroyed by interference with SF" <<
-	          //              unsigned(currentSf));
-
-	          //NS_LOG_DEBUG ("RX Power " << rxPowerDbm << " SNIR " << snir);
-	          m_colsf = currentSf;
-
-	          interferred = true;
-	        }
-	    }
-
-	  // Check if packet survives due to capture effect:
-	  // -- > The event starts before all the other interferer events
-	  // -- > The preamble was not interferred, meaning that the GW does not loose the synchronization
-	  // -- > The signal strength of the first event is bigger than the cumulative interference energy
-
-	  if (first_counter == interferer_counter){
-		  if (preamble_counter == 0) {
-			  double snirIsolation = collisionSnir [unsigned(sf)-7][unsigned(sf)-7];
-			  double snir = 10*log10 (signalEnergy/cumulativeInterferenceEnergy.at (unsigned(sf)-7));
-			  if (snir >= snirIsolation) {
-				  interferred = false;
-				  m_ce = true;
-				  //NS_LOG_DEBUG ("Packet survive due to CE ");
-	          }
-	      }
-	  }
-
-	  ///NS_LOG_DEBUG ("First counter " << first_counter);
-	  //NS_LOG_DEBUG ("Interferer counter " << interferer_counter);
-	  //NS_LOG_DEBUG ("Preamble counter " << preamble_counter);
-	  //NS_LOG_DEBUG ("Cumul Energy " << cumulativeInterferenceEnergy.at (unsigned(sf)-7));
-	  //NS_LOG_DEBUG ("Signal Energy " << signalEnergy);
-
-
-	  return interferred;
+LoraInterferenceHelper::IsDestroyedByInterference
+  (Ptr<LoraInterferenceHelper::Event> event) const
+{
+  return Evaluate (event).destroyed;
 }
 
+double
+LoraInterferenceHelper::GetSINR (Ptr<LoraInterferenceHelper::Event> event) const
+{
+  return Evaluate (event).sinr;
+}
 
 void
 LoraInterferenceHelper::ClearAllEvents (void)
 {
   //NS_LOG_FUNCTION_NOARGS ();
 
-  m_events.clear ();
+  for (auto freq = m_buckets.begin (); freq != m_buckets.end (); freq++)
+    {
+      for (auto bucket = freq->second.begin (); bucket != freq->second.end ();
+           bucket++)
+        {
+          bucket->Clear ();
+        }
+    }
+  m_expiryQueue.clear ();
+  m_nEvents = 0;
+  m_background.clear ();
 }
 
 Time
@@ -947,15 +1275,11 @@ LoraInterferenceHelper::GetOverlapTime (Ptr<LoraInterferenceHelper::Event> event
       else if (e1 >= e2)
         {
           overlap = e2 - s2;
-          m_colstart = s2;
-          m_colend = e2;
         }
       // Partially overlapping events
       else
         {
           overlap = e1 - s2;
-          m_colstart = s2;
-          m_colend = e1;
         }
     }
   // Event2 starts before Event1
@@ -970,15 +1294,11 @@ LoraInterferenceHelper::GetOverlapTime (Ptr<LoraInterferenceHelper::Event> event
       else if (e2 >= e1)
         {
           overlap = e1 - s1;
-          m_colstart = s1;
-          m_colend = e1;
         }
       // Partially overlapping events
       else
         {
           overlap = e2 - s1;
-          m_colstart = s1;
-          m_colend = e2;
         }
     }
   return overlap;
@@ -991,35 +1311,21 @@ LoraInterferenceHelper::OnThePreamble (Ptr<LoraInterferenceHelper::Event> event1
 {
   //NS_LOG_FUNCTION_NOARGS ();
 
+  return OnThePreamble (event1->GetStartTick (), event1->GetEndTick (),
+                        event1->GetTransmission ()->GetPreamble ().GetTimeStep (),
+                        event2->GetStartTick ());
+}
 
-  Ptr<Packet> packet1 = event1->GetPacket ();
-  Ptr<Packet> packet2 = event1->GetPacket ();
-
-
-  LoraTag tag1;
-  packet1->RemovePacketTag (tag1);
-  Time p1 = Seconds(tag1.GetPreamble ());
-  packet1->AddPacketTag (tag1);
-
-
-  LoraTag tag2;
-  packet2->RemovePacketTag (tag2);
-  Time p2= Seconds(tag2.GetPreamble ());
-  packet2->AddPacketTag (tag2);
-
+bool
+LoraInterferenceHelper::OnThePreamble (int64_t startTick, int64_t endTick,
+                                       int64_t preambleTicks,
+                                       int64_t interfererStartTick)
+{
   // Get handy values
-  Time s1 = event1->GetStartTime (); // Start times
-  Time s2 = event2->GetStartTime ();
-  Time e1 = event1->GetEndTime ();   // End times
-  Time e2 = event2->GetEndTime ();
-
-  //NS_LOG_DEBUG ("s1 " << s1.GetMilliSeconds () << " ms.");
-  //NS_LOG_DEBUG ("s2 " << s2.GetMilliSeconds () << " ms.");
-  //NS_LOG_DEBUG ("e1 " << e1.GetMilliSeconds () << " ms.");
-  //NS_LOG_DEBUG ("e2 " << e2.GetMilliSeconds () << " ms.");
-  //NS_LOG_DEBUG ("p1 " << p1.GetMilliSeconds () << " ms.");
-  //NS_LOG_DEBUG ("p2 " << p2.GetMilliSeconds () << " ms.");
-
+  int64_t s1 = startTick; // Start times
+  int64_t s2 = interfererStartTick;
+  int64_t e1 = endTick;   // End time
+  int64_t preamble = preambleTicks;
 
   bool OnThePreambule;
 
@@ -1031,7 +1337,7 @@ LoraInterferenceHelper::OnThePreamble (Ptr<LoraInterferenceHelper::Event> event1
         {
     	  OnThePreambule = false;
         }
-      else if (s2 <= s1 + p1)
+      else if (s2 <= s1 + preamble)
         {
 		  OnThePreambule = true;
 	    }
@@ -1055,80 +1361,8 @@ LoraInterferenceHelper::GetFirst (Ptr<LoraInterferenceHelper::Event> event1,
 {
   //NS_LOG_FUNCTION_NOARGS ();
 
-
-  Ptr<Packet> packet1 = event1->GetPacket ();
-  Ptr<Packet> packet2 = event1->GetPacket ();
-
-
-  LoraTag tag1;
-  packet1->PeekPacketTag (tag1);
-  Time p1 = Seconds(tag1.GetPreamble ());
-  //packet1->AddPacketTag (tag1);
-
-
-  LoraTag tag2;
-  packet2->PeekPacketTag (tag2);
-  Time p2= Seconds(tag2.GetPreamble ());
-  //packet2->AddPacketTag (tag2);
-
-  // Get handy values
-  Time s1 = event1->GetStartTime (); // Start times
-  Time s2 = event2->GetStartTime ();
-  Time e1 = event1->GetEndTime ();   // End times
-  Time e2 = event2->GetEndTime ();
-
-  bool First;
-
   // Event1 starts before Event2
-  if (s1 < s2)
-    {
-	  First = true;
-    }
-  return First;
+  return event1->GetStartTime () < event2->GetStartTime ();
 }
 
-
-bool
-LoraInterferenceHelper::GetOnThePreamble (void)
-{
-	return m_onthepreamble;
-}
-
-Time
-LoraInterferenceHelper::GetColStart (void)
-{
-	return m_colstart;
-}
-
-Time
-LoraInterferenceHelper::GetColEnd (void)
-{
-	return m_colend;
-}
-
-uint8_t
-LoraInterferenceHelper::GetSF (void)
-{
-	return m_colsf;
 }
-
-bool
-LoraInterferenceHelper::GetCE (void)
-{
-	return m_ce;
-}
-
-void
-LoraInterferenceHelper::CleanParameters(void)
-{
-	m_onthepreamble = false;
-	m_colstart = Seconds(0);
-	m_colend = Seconds(0);
-	m_colsf = uint8_t(0);
-	m_ce = false;
-}
-
-
-}
-
-
@@ -31,7 +31,12 @@
 #include "ns3/packet.h"
 #include "ns3/logical-lora-channel.h"
 #include "ns3/lora-tag.h"
+#include <deque>
+#include <functional>
 #include <list>
+#include <map>
+#include <queue>
+#include <vector>
 
 namespace ns3 {
 
@@ -60,15 +65,145 @@ public:
 		Cochannel_Matrix,
     };
 
+  /**
+   * A transmission on the channel.
+   *
+   * The description of a transmission does not depend on who hears it, so it
+   * is created once by the LoraChannel and shared by all the receivers, which
+   * only keep a reference to it together with the power they receive it with.
+   */
+  class Transmission : public SimpleRefCount<LoraInterferenceHelper::Transmission>
+  {
+
+public:
+
+    Transmission (Time duration, uint8_t spreadingFactor, Ptr<Packet> packet,
+                  double frequencyMHz);
+    ~Transmission ();
+
+    /**
+     * Get the identifier of this transmission, unique in the simulation.
+     */
+    uint64_t GetId (void) const;
+
+    /**
+     * Get the duration of the transmission.
+     */
+    Time GetDuration (void) const;
+
+    /**
+     * Get the spreading factor used by this transmission.
+     */
+    uint8_t GetSpreadingFactor (void) const;
+
+    /**
+     * Get the packet carried by this transmission.
+     */
+    Ptr<Packet> GetPacket (void) const;
+
+    /**
+     * Get the frequency this transmission is on.
+     */
+    double GetFrequency (void) const;
+
+    /**
+     * Get the id of the node that sent the transmission.
+     */
+    uint32_t GetSenderId (void) const;
+
+    /**
+     * Get whether the transmission was sent by a jammer.
+     */
+    bool IsJammer (void) const;
+
+    /**
+     * Get the duration of the preamble of the transmission.
+     */
+    Time GetPreamble (void) const;
+
+    /**
+     * Get the identifier the sender gave to the packet.
+     */
+    uint32_t GetPacketId (void) const;
+
+    /**
+     * Get the number of times the sender transmitted the packet.
+     */
+    uint32_t GetNtx (void) const;
+
+private:
+
+    /**
+     * The identifier of this transmission.
+     */
+    uint64_t m_id;
+
+    /**
+     * The duration of this transmission.
+     */
+    Time m_duration;
+
+    /**
+     * The spreading factor of this transmission.
+     */
+    uint8_t m_sf;
+
+    /**
+     * The packet carried by this transmission.
+     */
+    Ptr<Packet> m_packet;
+
+    /**
+     * The frequency of this transmission.
+     */
+    double m_frequencyMHz;
+
+    /**
+     * The metadata of the packet's LoraTag, read once when the transmission
+     * is created so that receivers do not need to access the tag.
+     */
+    uint32_t m_senderId;
+    bool m_jammer;
+    Time m_preamble;
+    uint32_t m_packetId;
+    uint32_t m_ntx;
+
+    /**
+     * The identifier of the next transmission to be created.
+     */
+    static uint64_t s_nextId;
+  };
+
+  /**
+   * A transmission as received by a device.
+   */
   class Event : public SimpleRefCount<LoraInterferenceHelper::Event>
   {
 
 public:
 
-    Event (Time duration, double rxPowerdBm, uint8_t spreadingFactor,
-           Ptr<Packet> packet, double frequencyMHz);
+    Event (Ptr<const LoraInterferenceHelper::Transmission> transmission,
+           double rxPowerdBm);
+
+    /**
+     * Build an event for a transmission that started in the past.
+     */
+    Event (Ptr<const LoraInterferenceHelper::Transmission> transmission,
+           double rxPowerdBm, int64_t startTick, int64_t endTick);
     ~Event ();
 
+    /**
+     * Events are allocated from a pool of recycled ones, since they are
+     * created for every transmission heard by every device.
+     */
+    static void *operator new (size_t size);
+    static void operator delete (void *p);
+
+    /**
+     * Get the transmission this event was generated for.
+     */
+    Ptr<const LoraInterferenceHelper::Transmission> GetTransmission (void) const;
+
     /**
      * Get the duration of the event.
      */
@@ -84,11 +219,26 @@ public:
      */
     Time GetEndTime (void) const;
 
+    /**
+     * Get the starting time of the event, in simulator time steps.
+     */
+    int64_t GetStartTick (void) const;
+
+    /**
+     * Get the ending time of the event, in simulator time steps.
+     */
+    int64_t GetEndTick (void) const;
+
     /**
      * Get the power of the event.
      */
     double GetRxPowerdBm (void) const;
 
+    /**
+     * Get the power of the event in W.
+     */
+    double GetRxPowerW (void) const;
+
     /**
      * Get the spreading factor used by this signal.
      */
@@ -104,6 +254,36 @@ public:
      */
     double GetFrequency (void) const;
 
+    /**
+     * Set the index of the demodulator of the device that is locked on this
+     * event.
+     *
+     * \param demodulator The index, or -1 if no demodulator is locked.
+     */
+    void SetDemodulator (int32_t demodulator);
+
+    /**
+     * Get the index of the demodulator of the device that is locked on this
+     * event.
+     *
+     * \return The index, or -1 if no demodulator is locked.
+     */
+    int32_t GetDemodulator (void) const;
+
+    /**
+     * Set the background noise energy accumulated on the frequency of the
+     * event when it started.
+     *
+     * \param energy The energy, in W times time steps.
+     */
+    void SetBackgroundEnergyAtStart (double energy);
+
+    /**
+     * Get the background noise energy accumulated on the frequency of the
+     * event when it started, in W times time steps.
+     */
+    double GetBackgroundEnergyAtStart (void) const;
+
     /**
      * Print the current event in a human readable form.
      */
@@ -112,37 +292,126 @@ public:
 private:
 
     /**
-     * The time this signal begins (at the device).
+     * The transmission this event was generated for.
      */
-    Time m_startTime;
+    Ptr<const LoraInterferenceHelper::Transmission> m_transmission;
 
     /**
-     * The time this signal ends (at the device).
+     * The start and end times of this signal (at the device), in simulator
+     * time steps.
      */
-    Time m_endTime;
+    int64_t m_startTick;
+    int64_t m_endTick;
 
     /**
-     * The spreading factor of this signal.
+     * The power of this event in dBm (at the device).
      */
-    uint8_t m_sf;
+    double m_rxPowerdBm;
 
     /**
-     * The power of this event in dBm (at the device).
+     * The power of this event in W (at the device), computed once so that
+     * interference can be accumulated in the linear domain.
      */
-    double m_rxPowerdBm;
+    double m_rxPowerW;
 
     /**
-     * The packet this event was generated for.
+     * The demodulator locked on this event, or -1.
      */
-    Ptr<Packet> m_packet;
+    int32_t m_demodulator;
 
     /**
-     * The frequency this event was on.
+     * The background noise energy accumulated on the frequency of this event
+     * when it started, in W times time steps.
      */
-    double m_frequencyMHz;
+    double m_backgroundEnergyAtStart;
 
   };
 
+  /**
+   * The outcome of the evaluation of an event against the interference
+   * registered in a LoraInterferenceHelper.
+   *
+   * All the fields are computed in a single pass over the interferers that
+   * overlap with the event, so that no state is kept in the helper between
+   * evaluations.
+   */
+  struct Result
+  {
+    bool destroyed; //!< Whether the event was destroyed by interference.
+    double sinr; //!< The SINR of the event with respect to same-SF interferers [dB].
+    double interferenceEnergy[6]; //!< The interference energy [J] of each SF,
+                                  //!< index 0 is SF7. Only the event's SF is
+                                  //!< filled unless the Cochannel_Matrix model
+                                  //!< is used. The background noise counts
+                                  //!< toward the event's SF.
+    uint8_t colSf; //!< The SF that destroyed the event, 0 if not destroyed.
+    Time colStart; //!< Start of the collision with the latest overlapping interferer.
+    Time colEnd; //!< End of the collision with the latest overlapping interferer.
+    bool onThePreamble; //!< Whether the latest overlapping interferer hit the preamble.
+    bool captureEffect; //!< Whether the event survived thanks to capture effect.
+    uint32_t nInterferers; //!< The number of overlapping interferers.
+    uint32_t nLaterInterferers; //!< The number of overlapping interferers
+                                //!< that started after the event.
+    uint32_t nPreambleInterferers; //!< The number of overlapping interferers
+                                   //!< that hit the preamble of the event.
+    double signalEnergy; //!< The energy [J] of the event.
+    double maxInterferencePowerDbm; //!< The power of the strongest interferer
+                                    //!< using the event's SF, -1000 if none.
+  };
+
+  /**
+   * An interference model, deciding whether an event survives based on the
+   * interference it experienced.
+   *
+   * Models are stateless, and can be shared by any number of helpers.
+   * New models can be made available to GatewayLoraPhy::SetInterferenceModel
+   * through RegisterModel.
+   */
+  class Model : public SimpleRefCount<LoraInterferenceHelper::Model>
+  {
+
+public:
+
+    virtual ~Model ();
+
+    /**
+     * Evaluate the outcome of an event.
+     *
+     * \param helper The helper holding the interferers.
+     * \param event The event for which to check the outcome.
+     * \return The outcome of the reception of the event.
+     */
+    virtual Result Evaluate (const LoraInterferenceHelper &helper,
+                             Ptr<LoraInterferenceHelper::Event> event) const = 0;
+  };
+
+  /**
+   * A Model built from a policy class, so that the scan of the interferers
+   * and the decision are compiled together for each model.
+   *
+   * The policy must provide:
+   * - static const bool crossSf, true if interferers using a different SF are
+   *   to be accounted for;
+   * - static void Decide (const LoraInterferenceHelper &helper,
+   *   Ptr<LoraInterferenceHelper::Event> event, Result &result), setting
+   *   result.destroyed (and, if needed, result.colSf and
+   *   result.captureEffect) from the fields filled by Scan.
+   */
+  template <class Policy>
+  class PolicyModel : public Model
+  {
+
+public:
+
+    virtual Result Evaluate (const LoraInterferenceHelper &helper,
+                             Ptr<LoraInterferenceHelper::Event> event) const
+    {
+      Result result = helper.Scan<Policy::crossSf> (event);
+      Policy::Decide (helper, event, result);
+      return result;
+    }
+  };
+
   static TypeId GetTypeId (void);
 
   LoraInterferenceHelper();
@@ -165,47 +434,162 @@ private:
                                           Ptr<Packet> packet,
                                           double frequencyMHz);
 
+  /**
+   * Add an event for a transmission that was already described by the
+   * channel.
+   *
+   * \param transmission The transmission that is being received.
+   * \param rxPower the received power in dBm.
+   *
+   * \return the newly created event
+   */
+  Ptr<LoraInterferenceHelper::Event>
+  Add (Ptr<const LoraInterferenceHelper::Transmission> transmission,
+       double rxPower);
+
   /**
    * Get a list of the interferers currently registered at this
    * InterferenceHelper.
    */
   std::list< Ptr< LoraInterferenceHelper::Event > > GetInterferers ();
 
+  /**
+   * Account for a transmission that is too weak to affect any reception on
+   * its own as background noise, instead of storing it as an event.
+   *
+   * Its power is added to the background noise of its frequency while it is
+   * on the air, and the background energy that overlaps with an event is
+   * added to the noise in the SINR of the event.
+   *
+   * \param transmission The transmission that is being received.
+   * \param rxPower the received power in dBm.
+   */
+  void AddBackground (Ptr<const LoraInterferenceHelper::Transmission>
+                      transmission, double rxPower);
+
+  /**
+   * Get the number of transmissions accounted for as background noise.
+   */
+  uint64_t GetNBackgroundSignals (void) const;
+
 
   void SetInterferenceModel(Int_Model);
 
-  Int_Model GetInterferenceModel(void);
+  /**
+   * Get the last built-in model that was set, regardless of any model set
+   * with SetModel afterwards.
+   */
+  Int_Model GetInterferenceModel(void) const;
 
+  /**
+   * Set the model used to evaluate events.
+   */
+  void SetModel (Ptr<const LoraInterferenceHelper::Model> model);
+
+  /**
+   * Get the model used to evaluate events.
+   */
+  Ptr<const LoraInterferenceHelper::Model> GetModel (void) const;
+
+  /**
+   * Make a model available under a numeric identifier.
+   *
+   * The built-in models are registered as 1 (Pure_ALOHA), 2 (CE_PowerLevel),
+   * 3 (CE_CumulEnergy) and 4 (Cochannel_Matrix). Registering a model with an
+   * existing identifier replaces it.
+   *
+   * \param id The identifier of the model.
+   * \param model The model.
+   */
+  static void RegisterModel (uint8_t id,
+                             Ptr<const LoraInterferenceHelper::Model> model);
+
+  /**
+   * Get the model registered with an identifier.
+   *
+   * \return The model, or 0 if no model uses this identifier.
+   */
+  static Ptr<const LoraInterferenceHelper::Model> LookupModel (uint8_t id);
 
   void SetDelta (double delta);
 
-  uint8_t GetDelta (void);
+  uint8_t GetDelta (void) const;
 
   /**
-   * Print the events that are saved in this helper in a human readable format.
+   * Get the delta used by the CE models, in linear scale.
    */
-  void PrintEvents (std::ostream &stream);
+  double GetDeltaLinear (void) const;
 
   /**
-   * Determine whether the event was destroyed by interference or not. This is
-   * the method where the SNIR tables come into play and the computations
-   * regarding power are performed.
+   * Get the minimum ratio between the energy of a signal and that of the
+   * interference from a certain SF needed to receive the signal, in linear
+   * scale, according to the co-channel rejection matrix.
+   *
+   * \param sf The SF of the signal.
+   * \param interfererSf The SF of the interference.
+   */
+  static double GetIsolation (uint8_t sf, uint8_t interfererSf);
 
-   * \param event The event for which to check the outcome.
-   * \return The sf of the packets that caused the loss, or 0 if there was no
-   * loss.
+  /**
+   * Get the six isolation values of a signal's SF (index 0 is SF7), in linear
+   * scale.
+   *
+   * \param sf The SF of the signal.
    */
-  bool IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event);
+  static const double *GetIsolationRow (uint8_t sf);
 
-  bool Cochannel (Ptr<LoraInterferenceHelper::Event> event);
+  /**
+   * Get the largest value of the co-channel rejection matrix [dB], that is
+   * the weakest interference, relative to a signal, that can destroy it.
+   */
+  static double GetMaxIsolationDb (void);
 
-  bool Aloha (Ptr<LoraInterferenceHelper::Event> event);
+  /**
+   * Print the events that are saved in this helper in a human readable format.
+   */
+  void PrintEvents (std::ostream &stream);
 
-  bool CumulEnergy (Ptr<LoraInterferenceHelper::Event> event);
+  /**
+   * Evaluate the outcome of an event against the registered interferers.
+   *
+   * This is the method where the SNIR tables come into play and the
+   * computations regarding power are performed, according to the configured
+   * interference model. The interferers overlapping with the event are
+   * scanned only once.
+   *
+   * \param event The event for which to check the outcome.
+   * \return The outcome of the reception of the event.
+   */
+  Result Evaluate (Ptr<LoraInterferenceHelper::Event> event) const;
 
-  double GetSINR(Ptr<LoraInterferenceHelper::Event> event);
+  /**
+   * Scan the interferers overlapping with an event, filling all the fields
+   * of a Result except for the decision (destroyed, colSf and captureEffect,
+   * which are left false and 0).
+   *
+   * This is instantiated for both values of crossSf.
+   *
+   * \tparam crossSf Whether interferers using a different SF are considered.
+   * \param event The event for which to scan the interferers.
+   */
+  template <bool crossSf>
+  Result Scan (Ptr<LoraInterferenceHelper::Event> event) const;
 
-  bool PowerLevel (Ptr<LoraInterferenceHelper::Event> event);
+  /**
+   * Determine whether the event was destroyed by interference or not.
+   *
+   * \param event The event for which to check the outcome.
+   * \return True if the event was destroyed, false otherwise.
+   */
+  bool IsDestroyedByInterference (Ptr<LoraInterferenceHelper::Event> event) const;
+
+  /**
+   * Get the SINR of an event with respect to the interferers using its SF.
+   *
+   * \param event The event for which to compute the SINR.
+   * \return The SINR [dB].
+   */
+  double GetSINR (Ptr<LoraInterferenceHelper::Event> event) const;
 
    /**
    * Compute the time duration in which two given events are overlapping.
@@ -215,15 +599,23 @@ private:
    *
    * \return The overlap time
    */
-  Time GetOverlapTime (Ptr< LoraInterferenceHelper:: Event> event1,
-                       Ptr<LoraInterferenceHelper:: Event> event2);
-
+  static Time GetOverlapTime (Ptr< LoraInterferenceHelper:: Event> event1,
+                              Ptr<LoraInterferenceHelper:: Event> event2);
 
-  bool OnThePreamble (Ptr< LoraInterferenceHelper:: Event> event1,
-                       Ptr<LoraInterferenceHelper:: Event> event2);
+  /**
+   * Check whether event2 overlaps with the preamble of event1.
+   *
+   * \param event1 The event whose preamble is considered
+   * \param event2 The interfering event
+   */
+  static bool OnThePreamble (Ptr< LoraInterferenceHelper:: Event> event1,
+                             Ptr<LoraInterferenceHelper:: Event> event2);
 
-  bool GetFirst (Ptr<LoraInterferenceHelper::Event> event1,
-                 Ptr<LoraInterferenceHelper::Event> event2);
+  /**
+   * Check whether event1 started before event2.
+   */
+  static bool GetFirst (Ptr<LoraInterferenceHelper::Event> event1,
+                        Ptr<LoraInterferenceHelper::Event> event2);
 
 
   /**
@@ -232,28 +624,46 @@ private:
   void ClearAllEvents (void);
 
   /**
-   * Delete old events in this LoraInterferenceHelper.
+   * Delete the events that ended more than the horizon ago.
+   *
+   * Events are retired in the order they were added, so each call only
+   * touches the events it removes plus one. This is done by Add, and there is
+   * usually no need to call it directly.
    */
   void CleanOldEvents (void);
 
-  bool GetOnThePreamble (void);
-
-  Time GetColStart (void);
-
-  Time GetColEnd (void);
+  /**
+   * Set the time an event is kept after its end.
+   *
+   * Since an event can only interfere with receptions that are still
+   * ongoing when it ends, the horizon needs to be at least as long as the
+   * longest reception.
+   *
+   * \param horizon The new horizon.
+   */
+  void SetHorizon (Time horizon);
 
-  uint8_t GetSF (void);
+  /**
+   * Get the time an event is kept after its end.
+   */
+  Time GetHorizon (void) const;
 
-  bool  GetCE (void);
+  /**
+   * Get the longest possible on-air time of a LoRa frame, i.e., that of a
+   * frame carrying the maximum payload at SF12. This is the default horizon.
+   */
+  static Time GetMaxOnAirTime (void);
 
-  void CleanParameters(void);
+  /**
+   * Get the largest number of events that were stored at the same time.
+   */
+  uint32_t GetHighWaterMark (void) const;
 
-  bool m_onthepreamble;
-  bool m_preamble;
-  bool m_ce;
-  Time m_colstart;
-  Time m_colend;
-  uint8_t m_colsf;
+  /**
+   * Set a callback to be invoked with the new value every time the number of
+   * stored events reaches a new maximum.
+   */
+  void SetHighWaterCallback (Callback<void, uint32_t> callback);
 
   Int_Model m_intmodel;
   double m_delta;
@@ -261,9 +671,246 @@ private:
 private:
 
   /**
-   * A list of the events this LoraInterferenceHelper is keeping track of.
+   * A collection of the events impinging on the device on a single frequency
+   * and spreading factor, sorted by start time.
+   *
+   * Since events are always created at the current simulation time, appending
+   * them keeps the bucket sorted. The events that may overlap a given interval
+   * can then be found with two binary searches, using the longest duration
+   * ever stored in the bucket to bound how early an overlapping event could
+   * have started.
+   *
+   * The data needed to compute interference is stored as contiguous columns
+   * (start, end and power), so that scans do not need to dereference the
+   * transmissions. The frequency and the spreading factor are implied by the
+   * bucket. No Event object is kept: an event is stored as a reference to its
+   * shared transmission plus the values that depend on the receiver.
+   * Events live in the slots between Begin () and End (): removed slots at
+   * the front are recycled by moving the live range back when more than half
+   * of the storage is unused, so that in steady state no allocation is made.
+   */
+  class EventBucket
+  {
+
+public:
+
+    EventBucket ();
+
+    /**
+     * Append an event to the bucket.
+     *
+     * \param event The event to add, which must not start before the last one.
+     */
+    void Insert (Ptr<LoraInterferenceHelper::Event> event);
+
+    /**
+     * Get the index of the first stored event.
+     */
+    uint32_t Begin (void) const;
+
+    /**
+     * Get the index after the last stored event.
+     */
+    uint32_t End (void) const;
+
+    /**
+     * Get the index of the first event that could still be on the air at a
+     * given time.
+     *
+     * \param startTick The beginning of the interval of interest.
+     */
+    uint32_t OverlapBegin (int64_t startTick) const;
+
+    /**
+     * Get the index after the last event that started no later than a given
+     * time.
+     *
+     * \param endTick The end of the interval of interest.
+     */
+    uint32_t OverlapEnd (int64_t endTick) const;
+
+    /**
+     * Get the start time, in time steps, of the event at an index.
+     */
+    int64_t GetStartTick (uint32_t i) const;
+
+    /**
+     * Get the end time, in time steps, of the event at an index.
+     */
+    int64_t GetEndTick (uint32_t i) const;
+
+    /**
+     * Get the power, in W, of the event at an index.
+     */
+    double GetRxPowerW (uint32_t i) const;
+
+    /**
+     * Get the power, in dBm, of the event at an index.
+     */
+    double GetRxPowerdBm (uint32_t i) const;
+
+    /**
+     * Get the transmission of the event at an index.
+     */
+    const Ptr<const LoraInterferenceHelper::Transmission> &
+    GetTransmission (uint32_t i) const;
+
+    /**
+     * Remove the event that started first.
+     */
+    void PopFront (void);
+
+    /**
+     * Delete all events in this bucket.
+     */
+    void Clear (void);
+
+private:
+
+    /**
+     * Give the slots before m_first back to the bucket, if they make up for
+     * more than half of the storage.
+     */
+    void Recycle (void);
+
+    /**
+     * Columns describing the events in this bucket, sorted by start time.
+     */
+    std::vector<int64_t> m_startTicks;
+    std::vector<int64_t> m_endTicks;
+    std::vector<double> m_rxPowerW;
+    std::vector<double> m_rxPowerdBm;
+    std::vector< Ptr<const LoraInterferenceHelper::Transmission> >
+    m_transmissions;
+
+    /**
+     * The index of the first slot holding an event.
+     */
+    uint32_t m_first;
+
+    /**
+     * The longest duration, in time steps, of the events stored in this
+     * bucket.
+     */
+    int64_t m_maxDuration;
+  };
+
+  /**
+   * Get the bucket holding events on a frequency and spreading factor,
+   * creating it if needed.
    */
-  std::list< Ptr< LoraInterferenceHelper::Event > > m_events;
+  EventBucket &GetBucket (double frequencyMHz, uint8_t spreadingFactor);
+
+  /**
+   * Get the bucket holding events on a frequency and spreading factor.
+   *
+   * \return The bucket, or 0 if no event was ever added to it.
+   */
+  const EventBucket *FindBucket (double frequencyMHz,
+                                 uint8_t spreadingFactor) const;
+
+  /**
+   * Check whether an interferer overlaps with the preamble of an event.
+   *
+   * \param startTick The start of the event, in time steps.
+   * \param endTick The end of the event, in time steps.
+   * \param preambleTicks The duration of the event's preamble, in time steps.
+   * \param interfererStartTick The start of the interferer, in time steps.
+   */
+  static bool OnThePreamble (int64_t startTick, int64_t endTick,
+                             int64_t preambleTicks,
+                             int64_t interfererStartTick);
+
+  /**
+   * The events this LoraInterferenceHelper is keeping track of, indexed by
+   * frequency and then by spreading factor (index 0 is SF7).
+   */
+  std::map<double, std::vector<EventBucket> > m_buckets;
+
+  /**
+   * The number of events currently stored in m_buckets.
+   */
+  uint32_t m_nEvents;
+
+  /**
+   * An event waiting to be retired, identified by the bucket it's stored in.
+   */
+  struct ExpiryEntry
+  {
+    EventBucket *bucket;
+    int64_t endTick;
+  };
+
+  /**
+   * The stored events, in the order they were added. Since every event is
+   * added at its start time, this is also the order in which each bucket
+   * stores them, so the head of this queue is always at the front of its
+   * bucket.
+   */
+  std::deque<ExpiryEntry> m_expiryQueue;
+
+  /**
+   * The time an event is kept after its end.
+   */
+  Time m_horizon;
+
+  /**
+   * The largest value m_nEvents ever reached.
+   */
+  uint32_t m_highWaterMark;
+
+  /**
+   * Callback invoked when m_highWaterMark grows.
+   */
+  Callback<void, uint32_t> m_highWaterCallback;
+
+  /**
+   * The background noise on a frequency, made of the transmissions passed to
+   * AddBackground.
+   */
+  struct BackgroundNoise
+  {
+    BackgroundNoise ();
+
+    double powerW; //!< The power currently on the air [W].
+    int64_t lastTick; //!< The time energy was last accumulated at.
+    double energy; //!< The energy accumulated until lastTick [W * steps].
+
+    /**
+     * The end time and power [W] of the transmissions still on the air,
+     * the earliest first.
+     */
+    std::priority_queue<std::pair<int64_t, double>,
+                        std::vector<std::pair<int64_t, double> >,
+                        std::greater<std::pair<int64_t, double> > > ends;
+  };
+
+  /**
+   * Accumulate the energy of some background noise until a time, removing
+   * the transmissions that ended before it.
+   *
+   * \param noise The background noise.
+   * \param tick The time, in time steps.
+   */
+  static void Advance (BackgroundNoise &noise, int64_t tick);
+
+  /**
+   * Get the background noise energy accumulated on a frequency until now.
+   *
+   * \param frequencyMHz The frequency.
+   * \return The energy, in W times time steps.
+   */
+  double GetBackgroundEnergy (double frequencyMHz) const;
+
+  /**
+   * The background noise on each frequency.
+   */
+  mutable std::map<double, BackgroundNoise> m_background;
+
+  /**
+   * The number of transmissions passed to AddBackground.
+   */
+  uint64_t m_nBackgroundSignals;
 
   /**
    * The matrix containing information about how packets survive interference.
@@ -271,10 +918,27 @@ private:
   static const double collisionSnir[6][6];
 
   /**
-   * The threshold after which an event is considered old and removed from the
-   * list.
+   * The collision matrix in linear scale, used to compare energy ratios
+   * without computing logarithms.
+   */
+  static const double collisionSnirLinear[6][6];
+
+  /**
+   * The delta used by the CE models, in linear scale.
+   */
+  double m_deltaLinear;
+
+  /**
+   * The model used to evaluate events.
+   */
+  Ptr<const LoraInterferenceHelper::Model> m_model;
+
+  /**
+   * Get the table of registered models, creating it with the built-in models
+   * on first use.
    */
-  static Time oldEventThreshold;
+  static std::map<uint8_t, Ptr<const LoraInterferenceHelper::Model> > &
+  GetModelRegistry (void);
 
 };
 
@@ -76,6 +76,12 @@ EndDeviceLoraPhy::EndDeviceLoraPhy () :
   m_cumulative_stb_conso (0),
   m_cumulative_sleep_conso (0)
 {
+  // A sleeping device does not need the transmissions on the channel
+  Unsubscribe ();
+
+  std::set<double> frequencies;
+  frequencies.insert (m_frequency);
+  SetListeningFrequencies (frequencies);
 }
 
 EndDeviceLoraPhy::~EndDeviceLoraPhy ()
@@ -249,51 +255,74 @@ EndDeviceLoraPhy::Send (Ptr<Packet> packet, LoraTxParameters txParams,
 
 void
 EndDeviceLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                                uint8_t sf, Time duration, double frequencyMHz)
+                                uint8_t sf, Time duration, double frequencyMHz,
+                                Ptr<const LoraInterferenceHelper::Transmission>
+                                transmission)
 {
 
   NS_LOG_FUNCTION (this << packet << rxPowerDbm << unsigned (sf) << duration <<
                    frequencyMHz);
   NS_LOG_INFO ("End device receive time -- " << Simulator::Now ().GetSeconds ());
 
+  // A device that is not listening has nothing to evaluate the signal
+  // against. The channel stops delivering transmissions to it, and replays
+  // the ones still on the air when it listens again, so only the deliveries
+  // that were already scheduled when it stopped get here. Those are kept
+  // aside until they leave the air instead of filling the interference
+  // helper.
+  if (m_state == SLEEP || m_state == TX || m_state == DEAD)
+    {
+      NS_LOG_INFO ("Not registering the signal because the device is not "
+                   "listening");
+
+      if (m_state == DEAD)
+        {
+          return;
+        }
+
+      // Forget the ones that already left the air
+      Time now = Simulator::Now ();
+      std::vector<MissedTransmission>::iterator it = m_missed.begin ();
+      while (it != m_missed.end ())
+        {
+          it = it->end <= now ? m_missed.erase (it) : it + 1;
+        }
+
+      MissedTransmission missed;
+      missed.transmission = transmission;
+      missed.rxPowerDbm = rxPowerDbm;
+      missed.end = now + duration;
+      m_missed.push_back (missed);
+      return;
+    }
+
   // Notify the LoraInterferenceHelper of the impinging signal, and remember
   // the event it creates. This will be used then to correctly handle the end
   // of reception event.
   //
-  // We need to do this regardless of our state or frequency, since these could
-  // change (and making the interference relevant) while the interference is
-  // still incoming.
+  // We need to do this regardless of our frequency, since it could change
+  // (and make the interference relevant) while the interference is still
+  // incoming.
 
   Ptr<LoraInterferenceHelper::Event> event;
-  event = m_interference.Add (duration, rxPowerDbm, sf, packet, frequencyMHz);
+  event = m_interference.Add (transmission, rxPowerDbm);
 
-  // Update the packet's LoraTag
-  LoraTag tag;
-  packet->RemovePacketTag (tag);
-  uint32_t SenderID = tag.GetSenderID();
-  packet->AddPacketTag (tag);
+  // Read the sender from the transmission, since the packet is shared by all
+  // receivers
+  uint32_t SenderID = transmission->GetSenderId ();
 
   // Switch on the current PHY state
   switch (m_state)
     {
-    // In the SLEEP, TX and RX cases we cannot receive the packet: we only add
-    // it to the list of interferers and do not schedule an EndReceive event for
-    // it.
+    // In the SLEEP, TX and DEAD cases we already returned above
     case SLEEP:
-      {
-        NS_LOG_INFO ("Dropping packet because device is in SLEEP state");
-        break;
-      }
     case TX:
-      {
-        NS_LOG_INFO ("Dropping packet because device is in TX state");
-        break;
-      }
     case DEAD:
       {
-        NS_LOG_INFO ("Dropping packet because end-device's battery is discharged");
         break;
       }
+    // In the RX case we cannot receive the packet: we only add it to the list
+    // of interferers and do not schedule an EndReceive event for it.
     case RX:
       {
         NS_LOG_INFO ("Dropping packet because device is already in RX state");
@@ -396,8 +425,7 @@ EndDeviceLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
             NS_LOG_INFO ("Scheduling reception of a packet. End in " <<
                          duration.GetSeconds () << " seconds");
 
-            Simulator::Schedule (duration, &LoraPhy::EndReceive, this, packet,
-                                 event);
+            ScheduleEndReceive (packet, event);
 
             // Fire the beginning of reception trace source
             m_phyRxBeginTrace (packet);
@@ -415,27 +443,26 @@ EndDeviceLoraPhy::EndReceive (Ptr<Packet> packet,
   // Fire the trace source
   m_phyRxEndTrace (packet);
 
-  // Update the packet's LoraTag
-  LoraTag tag;
-  packet->RemovePacketTag (tag);
-  uint32_t SenderID = tag.GetSenderID();
-  packet->AddPacketTag (tag);
+  uint32_t SenderID = event->GetTransmission ()->GetSenderId ();
 
   // Call the LoraInterferenceHelper to determine whether there was destructive
   // interference on this event.
-  bool packetDestroyed = m_interference.IsDestroyedByInterference (event);
+  LoraInterferenceHelper::Result result = m_interference.Evaluate (event);
+  bool packetDestroyed = result.destroyed;
 
   // Fire the trace source if packet was destroyed
   if (packetDestroyed)
     {
       NS_LOG_INFO ("ED - Packet destroyed by interference");
 
-      bool OnThePreamble = m_interference.GetOnThePreamble ();
-      Time colstart = m_interference.GetColStart ();
-      Time colend = m_interference.GetColEnd ();
-	  uint8_t colsf = m_interference.GetSF ();
+      bool OnThePreamble = result.onThePreamble;
+      Time colstart = result.colStart;
+      Time colend = result.colEnd;
+	  uint8_t colsf = result.colSf;
 
-      // Update the packet's LoraTag
+      // Update the LoraTag of a copy of the packet, since the packet is
+      // shared by all receivers
+      packet = packet->Copy ();
       LoraTag tag;
       packet->RemovePacketTag (tag);
       tag.SetDestroyedBy (packetDestroyed);
@@ -593,6 +620,11 @@ EndDeviceLoraPhy::SetFrequency (double frequencyMHz)
 {
   NS_LOG_FUNCTION (this << frequencyMHz);
   m_frequency = frequencyMHz;
+
+  // Only get the transmissions on the new frequency from the channel
+  std::set<double> frequencies;
+  frequencies.insert (m_frequency);
+  SetListeningFrequencies (frequencies);
 }
 
 double
@@ -615,9 +647,30 @@ EndDeviceLoraPhy::SwitchToStandby (void)
 
   m_state = STANDBY;
   StateDuration (Simulator::Now (), 3);
+
+  // Listen to the channel, including the transmissions already on the air
+  Subscribe ();
+  RegisterMissedTransmissions ();
   //NS_LOG_FUNCTION (this << "STB" << Simulator::Now ().GetSeconds ());
 }
 
+void
+EndDeviceLoraPhy::RegisterMissedTransmissions (void)
+{
+  NS_LOG_FUNCTION (this << m_missed.size ());
+
+  Time now = Simulator::Now ();
+  std::vector<MissedTransmission>::const_iterator it;
+  for (it = m_missed.begin (); it != m_missed.end (); it++)
+    {
+      if (it->end > now)
+        {
+          AddInterferer (it->transmission, it->rxPowerDbm, it->end - now);
+        }
+    }
+  m_missed.clear ();
+}
+
 void
 EndDeviceLoraPhy::SwitchToRx (void)
 {
@@ -650,6 +703,7 @@ EndDeviceLoraPhy::SwitchToTx (void)
   NS_ASSERT (m_state != RX);
   m_state = TX;
   StateDuration (Simulator::Now (), 1);
+  Unsubscribe ();
   //NS_LOG_FUNCTION (this << "TX" << Simulator::Now ().GetSeconds ());
 
 }
@@ -667,6 +721,11 @@ EndDeviceLoraPhy::SwitchToSleep (void)
 
   m_state = SLEEP;
   StateDuration (Simulator::Now (), 4);
+  Unsubscribe ();
+
+  // Nothing is added while sleeping, so retire the events that are already
+  // too old now instead of keeping them until the next one is
+  m_interference.CleanOldEvents ();
 
   NS_LOG_FUNCTION (this << "SLEEP" << Simulator::Now ().GetSeconds ());
 
@@ -677,6 +736,11 @@ EndDeviceLoraPhy::SwitchToDead (void)
 {
   //NS_LOG_FUNCTION_NOARGS ();
   m_state = DEAD;
+  Unsubscribe ();
+
+  // A dead device never listens again
+  m_interference.CleanOldEvents ();
+  m_missed.clear ();
 
 }
 
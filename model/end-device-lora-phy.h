@@ -30,6 +30,7 @@
 #include "ns3/mobility-model.h"
 #include "ns3/node.h"
 #include "ns3/lora-phy.h"
+#include <vector>
 
 namespace ns3 {
 
@@ -111,7 +112,9 @@ public:
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                             uint8_t sf, Time duration, double frequencyMHz);
+                             uint8_t sf, Time duration, double frequencyMHz,
+                             Ptr<const LoraInterferenceHelper::Transmission>
+                             transmission);
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void EndReceive (Ptr<Packet> packet,
@@ -222,6 +225,23 @@ private:
    */
   void SwitchToTx (void);
 
+  /**
+   * Register as interferers the transmissions that reached this device while
+   * it was not listening and that are still on the air, and forget the
+   * others.
+   */
+  void RegisterMissedTransmissions (void);
+
+  /**
+   * A transmission that reached this device while it was not listening.
+   */
+  struct MissedTransmission
+  {
+    Ptr<const LoraInterferenceHelper::Transmission> transmission;
+    double rxPowerDbm; //!< The power it is received with [dBm]
+    Time end;          //!< When it leaves the air at this device
+  };
+
   /**
    * Trace source for when a packet is lost because it was using a SF different from
    * the one this EndDeviceLoraPhy was configured to listen for.
@@ -249,6 +269,13 @@ private:
 
   int m_last_state;
 
+  /**
+   * The transmissions that were delivered after this device stopped
+   * listening. The channel only delivers a transmission once, so these are
+   * kept until they leave the air, in case the device listens again before.
+   */
+  std::vector<MissedTransmission> m_missed;
+
   /**
    * End-Device's Battery Level in Joules
    */
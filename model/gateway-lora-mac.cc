@@ -38,6 +38,13 @@ GatewayLoraMac::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::GatewayLoraMac")
     .SetParent<LoraMac> ()
     .AddConstructor<GatewayLoraMac> ()
+    .AddTraceSource ("ReceivedPacketMetadata",
+                     "Trace source indicating an uplink packet was "
+                     "correctly received at the MAC layer, with the "
+                     "metadata of its reception",
+                     MakeTraceSourceAccessor
+                       (&GatewayLoraMac::m_receivedPacketMetadata),
+                     "ns3::GatewayLoraMac::ReceivedPacketMetadataTracedCallback")
     .SetGroupName ("lorawan");
   return tid;
 }
@@ -103,22 +110,39 @@ GatewayLoraMac::Receive (Ptr<Packet const> packet)
 {
   NS_LOG_FUNCTION (this << packet);
 
-  // Make a copy of the packet to work on
-  Ptr<Packet> packetCopy = packet->Copy ();
+  ForwardUplink (packet);
+}
 
-  // Only forward the packet if it's uplink
-  LoraMacHeader macHdr;
-  packetCopy->PeekHeader (macHdr);
+void
+GatewayLoraMac::ReceiveWithMetadata (Ptr<Packet const> packet,
+                                     const LoraReceptionMetadata &metadata)
+{
+  NS_LOG_FUNCTION (this << packet << metadata);
 
-  if (macHdr.IsUplink ())
+  if (ForwardUplink (packet))
     {
-      m_device->GetObject<LoraNetDevice> ()->Receive (packetCopy);
-      m_receivedPacket (packet);
+      m_receivedPacketMetadata (packet, metadata);
     }
-  else
+}
+
+bool
+GatewayLoraMac::ForwardUplink (Ptr<Packet const> packet)
+{
+  NS_LOG_FUNCTION (this << packet);
+
+  // Only forward the packet if it's uplink
+  LoraMacHeader macHdr;
+  packet->PeekHeader (macHdr);
+
+  if (!macHdr.IsUplink ())
     {
       NS_LOG_DEBUG ("Not forwarding downlink message to NetDevice");
+      return false;
     }
+
+  m_device->GetObject<LoraNetDevice> ()->Receive (packet);
+  m_receivedPacket (packet);
+  return true;
 }
 
 void
@@ -46,6 +46,16 @@ public:
   // Implementation of the LoraMac interface
   virtual void Receive (Ptr<Packet const> packet);
 
+  /**
+   * Forward an uplink packet to the NetDevice, and fire the
+   * ReceivedPacketMetadata trace source with the metadata of its reception.
+   *
+   * \param packet the received packet
+   * \param metadata What the PHY knows about the reception
+   */
+  virtual void ReceiveWithMetadata (Ptr<Packet const> packet,
+                                    const LoraReceptionMetadata &metadata);
+
   // Implementation of the LoraMac interface
   virtual void TxFinished (Ptr<Packet const> packet);
 
@@ -55,7 +65,35 @@ public:
    * \return The next transmission time.
    */
   Time GetWaitingTime (double frequency);
+
+  /**
+   * TracedCallback signature for the reception of a packet together with
+   * the metadata of its reception.
+   *
+   * \param packet The received packet.
+   * \param metadata What the PHY knows about the reception.
+   */
+  typedef void (* ReceivedPacketMetadataTracedCallback)
+    (Ptr<const Packet> packet, const LoraReceptionMetadata &metadata);
+
 private:
+  /**
+   * Forward a packet to the NetDevice if it is an uplink one.
+   *
+   * The packet is not copied: it is shared with the PHY traces, and the
+   * upper layers copy it before adding their headers.
+   *
+   * \param packet the received packet
+   * \return Whether the packet was forwarded.
+   */
+  bool ForwardUplink (Ptr<Packet const> packet);
+
+  /**
+   * Trace source for the uplink packets forwarded to the NetDevice, with the
+   * metadata of their reception.
+   */
+  TracedCallback<Ptr<const Packet>, const LoraReceptionMetadata &>
+  m_receivedPacketMetadata;
 
 protected:
 
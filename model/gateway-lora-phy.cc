@@ -23,7 +23,12 @@
 #include "ns3/gateway-lora-phy.h"
 #include "ns3/lora-tag.h"
 #include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/string.h"
 #include "ns3/log.h"
+#include <algorithm>
+#include <fstream>
 
 using namespace std;
 namespace ns3 {
@@ -98,6 +103,32 @@ GatewayLoraPhy::ReceptionPath::SetFrequency (double frequencyMHz)
  *                 Implementation of Gateway methods                   *
  ***********************************************************************/
 
+ReceptionPathOccupancy::ReceptionPathOccupancy () :
+  saturatedTime (Seconds (0)),
+  peakBusyPaths (0)
+{
+}
+
+std::ostream &operator << (std::ostream &os,
+                           const ReceptionPathOccupancy &occupancy)
+{
+  os << "(busyTimeSec:";
+  for (unsigned i = 0; i < occupancy.busyTime.size (); i++)
+    {
+      os << " " << occupancy.busyTime[i].GetSeconds ();
+    }
+  os << ", saturatedTimeSec: " << occupancy.saturatedTime.GetSeconds () <<
+  ", peakBusyPaths: " << occupancy.peakBusyPaths << ", drops:";
+  std::map<std::pair<uint8_t, double>, uint64_t>::const_iterator it;
+  for (it = occupancy.drops.begin (); it != occupancy.drops.end (); it++)
+    {
+      os << " SF" << unsigned(it->first.first) << "@" << it->first.second <<
+      "MHz=" << it->second;
+    }
+  os << ")";
+  return os;
+}
+
 TypeId
 GatewayLoraPhy::GetTypeId (void)
 {
@@ -105,6 +136,34 @@ GatewayLoraPhy::GetTypeId (void)
     .SetParent<LoraPhy> ()
     .SetGroupName ("lorawan")
     .AddConstructor<GatewayLoraPhy> ()
+    .AddAttribute ("PruneInterferers",
+                   "Whether signals too weak to affect any reception are "
+                   "only accounted for as background noise, instead of "
+                   "being stored as interference events. Their energy "
+                   "counts as interference from the SF of each reception "
+                   "they overlap with, so that the energy-based models are "
+                   "at least as pessimistic as without pruning. They are "
+                   "not counted as interferers, which changes the outcome "
+                   "of the Pure_ALOHA model, where any overlap destroys a "
+                   "packet.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&GatewayLoraPhy::m_pruneInterferers),
+                   MakeBooleanChecker ())
+    .AddAttribute ("InterfererPruningMargin",
+                   "How far below the weakest signal that can destroy a "
+                   "reception signals are pruned [dB].",
+                   DoubleValue (10),
+                   MakeDoubleAccessor
+                     (&GatewayLoraPhy::m_interfererPruningMarginDb),
+                   MakeDoubleChecker<double> (0))
+    .AddAttribute ("OccupancyFile",
+                   "The file the statistics on the occupancy of the "
+                   "reception paths are appended to when the simulation is "
+                   "destroyed, with one line per gateway. Empty to disable.",
+                   StringValue (""),
+                   MakeStringAccessor (&GatewayLoraPhy::SetOccupancyFile,
+                                       &GatewayLoraPhy::GetOccupancyFile),
+                   MakeStringChecker ())
     .AddTraceSource ("LostPacketBecauseNoMoreReceivers",
                      "Trace source indicating a packet "
                      "could not be correctly received because"
@@ -121,8 +180,13 @@ GatewayLoraPhy::GetTypeId (void)
 }
 
 GatewayLoraPhy::GatewayLoraPhy () :
+  m_occupancyTick (0),
+  m_nSaturatedFrequencies (0),
+  m_occupancyDumpScheduled (false),
   m_isTransmitting (false),
-  m_authpre (false)
+  m_authpre (false),
+  m_pruneInterferers (false),
+  m_interfererPruningMarginDb (10)
 {
   NS_LOG_FUNCTION_NOARGS ();
 }
@@ -152,13 +216,129 @@ GatewayLoraPhy::AddReceptionPath (double frequencyMHz)
 
   m_receptionPaths.push_back (Create<GatewayLoraPhy::ReceptionPath>
                                 (frequencyMHz));
+
+  // A frequency whose paths were all busy gets a free one
+  std::map<double, std::vector<uint32_t> >::iterator freePaths =
+    m_freeReceptionPaths.find (frequencyMHz);
+  if (freePaths != m_freeReceptionPaths.end () && freePaths->second.empty ())
+    {
+      UpdateOccupancy ();
+      m_nSaturatedFrequencies--;
+    }
+  m_freeReceptionPaths[frequencyMHz].push_back (m_receptionPaths.size () - 1);
+
+  // Only get the transmissions on the frequencies of the reception paths
+  std::set<double> frequencies = GetListeningFrequencies ();
+  frequencies.insert (frequencyMHz);
+  SetListeningFrequencies (frequencies);
 }
 
 void
 GatewayLoraPhy::ResetReceptionPaths (void)
 {
   NS_LOG_FUNCTION (this);
+  UpdateOccupancy ();
   m_receptionPaths.clear ();
+  m_freeReceptionPaths.clear ();
+  m_nSaturatedFrequencies = 0;
+  SetListeningFrequencies (std::set<double> ());
+}
+
+double
+GatewayLoraPhy::GetInterfererPruningThreshold (void) const
+{
+  double lowestSensitivity = *std::min_element (sensitivity, sensitivity + 6);
+  return lowestSensitivity - LoraInterferenceHelper::GetMaxIsolationDb () -
+         m_interfererPruningMarginDb;
+}
+
+uint64_t
+GatewayLoraPhy::GetNPrunedInterferers (void) const
+{
+  return m_interference.GetNBackgroundSignals ();
+}
+
+// Account some time spent with a number of busy reception paths
+static void
+AccountOccupancy (ReceptionPathOccupancy &occupancy, int busyPaths,
+                  bool saturated, Time elapsed)
+{
+  uint32_t busy = std::max (0, busyPaths);
+  if (occupancy.busyTime.size () <= busy)
+    {
+      occupancy.busyTime.resize (busy + 1, Seconds (0));
+    }
+  occupancy.busyTime[busy] += elapsed;
+
+  if (saturated)
+    {
+      occupancy.saturatedTime += elapsed;
+    }
+}
+
+ReceptionPathOccupancy
+GatewayLoraPhy::GetReceptionPathOccupancy (void) const
+{
+  // Account the time since the last change on a copy
+  ReceptionPathOccupancy occupancy = m_occupancy;
+  AccountOccupancy (occupancy, m_occupiedReceptionPaths.Get (),
+                    m_nSaturatedFrequencies > 0,
+                    TimeStep (Simulator::Now ().GetTimeStep () -
+                              m_occupancyTick));
+  return occupancy;
+}
+
+void
+GatewayLoraPhy::SetOccupancyFile (std::string filename)
+{
+  NS_LOG_FUNCTION (this << filename);
+
+  m_occupancyFile = filename;
+
+  // The statistics are written once, however many times this is set
+  if (!m_occupancyFile.empty () && !m_occupancyDumpScheduled)
+    {
+      Simulator::ScheduleDestroy (&GatewayLoraPhy::DumpOccupancy,
+                                  Ptr<GatewayLoraPhy> (this));
+      m_occupancyDumpScheduled = true;
+    }
+}
+
+std::string
+GatewayLoraPhy::GetOccupancyFile (void) const
+{
+  return m_occupancyFile;
+}
+
+void
+GatewayLoraPhy::UpdateOccupancy (void)
+{
+  int64_t now = Simulator::Now ().GetTimeStep ();
+  AccountOccupancy (m_occupancy, m_occupiedReceptionPaths.Get (),
+                    m_nSaturatedFrequencies > 0,
+                    TimeStep (now - m_occupancyTick));
+  m_occupancyTick = now;
+}
+
+void
+GatewayLoraPhy::DumpOccupancy (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_occupancyFile.empty ())
+    {
+      return;
+    }
+
+  std::ofstream file (m_occupancyFile.c_str (), std::ios::app);
+  if (!file)
+    {
+      NS_LOG_WARN ("Cannot open " << m_occupancyFile);
+      return;
+    }
+
+  uint32_t id = m_device ? m_device->GetNode ()->GetId () : 0;
+  file << id << " " << GetReceptionPathOccupancy () << std::endl;
 }
 
 void
@@ -166,18 +346,19 @@ GatewayLoraPhy::SetInterferenceModel (uint8_t interference)
 {
   NS_LOG_FUNCTION (this);
 
-  switch (interference) {
-      case 1: m_interference.SetInterferenceModel(LoraInterferenceHelper::Pure_ALOHA);
-      	  	  break;
-      case 2: m_interference.SetInterferenceModel(LoraInterferenceHelper::CE_PowerLevel);
-      	  	  break;
-      case 3: m_interference.SetInterferenceModel(LoraInterferenceHelper::CE_CumulEnergy);
-              break;
-      case 4: m_interference.SetInterferenceModel(LoraInterferenceHelper::Cochannel_Matrix);
-              break;
-      default : m_interference.SetInterferenceModel(LoraInterferenceHelper::Pure_ALOHA);
-  }
+  // The built-in models are registered as 1 to 4, and models registered
+  // with LoraInterferenceHelper::RegisterModel are available too
+  Ptr<const LoraInterferenceHelper::Model> model =
+    LoraInterferenceHelper::LookupModel (interference);
 
+  if (model != 0)
+    {
+      m_interference.SetModel (model);
+    }
+  else
+    {
+      m_interference.SetInterferenceModel (LoraInterferenceHelper::Pure_ALOHA);
+    }
 }
 
 void
@@ -255,16 +436,17 @@ GatewayLoraPhy::IsTransmitting (void)
 
 void
 GatewayLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                              uint8_t sf, Time duration, double frequencyMHz)
+                              uint8_t sf, Time duration, double frequencyMHz,
+                              Ptr<const LoraInterferenceHelper::Transmission>
+                              transmission)
 {
   NS_LOG_FUNCTION (this << packet << rxPowerDbm << duration << frequencyMHz);
 
-  LoraTag tag;
-  packet->PeekPacketTag (tag);
-  uint32_t SenderID = tag.GetSenderID();
-  bool jammer = tag.GetJammer();
-  double preamble = tag.GetPreamble();
-  //packet->AddPacketTag (tag);
+  // Read the metadata from the transmission rather than from the packet's
+  // LoraTag
+  uint32_t SenderID = transmission->GetSenderId ();
+  bool jammer = transmission->IsJammer ();
+  double preamble = transmission->GetPreamble ().GetSeconds ();
 
   NS_LOG_INFO ("Jammer ? " << jammer);
   NS_LOG_INFO ("preamble ? " << preamble);
@@ -274,89 +456,108 @@ GatewayLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
   m_phyRxBeginTrace (packet);
 
 
-  // Add the event to the LoraInterferenceHelper
+  // Add the event to the LoraInterferenceHelper, unless it is too weak to
+  // matter on its own. Such signals are below the sensitivity, so they are
+  // never locked on by a reception path
   Ptr<LoraInterferenceHelper::Event> event;
 
-  event = m_interference.Add (duration, rxPowerDbm, sf, packet, frequencyMHz);
+  if (m_pruneInterferers && rxPowerDbm < GetInterfererPruningThreshold ())
+    {
+      NS_LOG_DEBUG ("Accounting for a signal of " << rxPowerDbm <<
+                    " dBm as background noise");
+      m_interference.AddBackground (transmission, rxPowerDbm);
+    }
+  else
+    {
+      event = m_interference.Add (transmission, rxPowerDbm);
+    }
 
   NS_LOG_INFO ("Inserting a packet on the collision helper with duration = "<< duration.GetSeconds());
   NS_LOG_INFO ("Added at " << Simulator::Now ().GetSeconds ());
 
-  // Cycle over the receive paths to check availability to receive the packet
-  std::list<Ptr<GatewayLoraPhy::ReceptionPath> >::iterator it;
+  // Take an available receive path listening on the channel of interest, if
+  // any
+  std::map<double, std::vector<uint32_t> >::iterator freePaths =
+    m_freeReceptionPaths.find (frequencyMHz);
 
-  for (it = m_receptionPaths.begin (); it != m_receptionPaths.end (); ++it)
+  if (freePaths != m_freeReceptionPaths.end () && !freePaths->second.empty ())
     {
-      Ptr<GatewayLoraPhy::ReceptionPath> currentPath = *it;
+      uint32_t path = freePaths->second.back ();
+      Ptr<GatewayLoraPhy::ReceptionPath> currentPath = m_receptionPaths[path];
 
       NS_LOG_DEBUG ("Current ReceptionPath is centered on frequency = " <<
                     currentPath->GetFrequency ());
 
-      // If the receive path is available and listening on the channel of
-      // interest, we have a candidate
-      if (currentPath->GetFrequency () == frequencyMHz &&
-          currentPath->IsAvailable ())
+      // See whether the reception power is above or below the sensitivity
+      // for that spreading factor
+      double sensitivity = GatewayLoraPhy::sensitivity[unsigned(sf)-7];
+
+      if (rxPowerDbm < sensitivity)   // Packet arrived below sensitivity
         {
-          // See whether the reception power is above or below the sensitivity
-          // for that spreading factor
-          double sensitivity = GatewayLoraPhy::sensitivity[unsigned(sf)-7];
+          NS_LOG_INFO ("Dropping packet reception of packet with sf = "
+                       << unsigned(sf) <<
+                       " because under the sensitivity of "
+                       << sensitivity << " dBm");
 
-          if (rxPowerDbm < sensitivity)   // Packet arrived below sensitivity
+          if (m_device)
             {
-              NS_LOG_INFO ("Dropping packet reception of packet with sf = "
-                           << unsigned(sf) <<
-                           " because under the sensitivity of "
-                           << sensitivity << " dBm");
-
-              if (m_device)
-                {
-                  m_underSensitivity (packet, m_device->GetNode ()->GetId (), SenderID, frequencyMHz, sf);
-                }
-              else
-                {
-                  m_underSensitivity (packet, 0, SenderID, frequencyMHz, sf);
-                }
-
-              // Since the packet is below sensitivity, it makes no sense to
-              // search for another ReceivePath
-              return;
+              m_underSensitivity (packet, m_device->GetNode ()->GetId (), SenderID, frequencyMHz, sf);
             }
-          else    // We have sufficient sensitivity to start receiving
+          else
             {
-              NS_LOG_INFO ("Scheduling reception of a packet, " <<
-                           "occupying one demodulator");
-
-              // Block this resource
-              currentPath->LockOnEvent (event);
-              m_occupiedReceptionPaths++;
-
-              // Check if authentificated preambles are enabled
-
-              if (m_authpre == true && jammer == false)
-              {
-            	  // Schedule the end of the reception of the packet
-            	  Simulator::Schedule (duration, &LoraPhy::EndReceive, this,packet, event);
-            	  m_packetduration(packet, duration ,m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (), event->GetSpreadingFactor () );
-
-              }
-
-              else if (m_authpre == true && jammer == true)
-              {
-            	  // Schedule the end of the reception of the packet right after the preamble
-            	  //Simulator::Schedule (Seconds(preamble), &LoraPhy::EndReceive, this, packet, event);
-            	  //m_packetduration(packet, Seconds(preamble) ,m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (), event->GetSpreadingFactor () );
-              }
-
-              else if (m_authpre == false)
-              {
-            	  // Schedule the end of the reception of the packet
-            	  Simulator::Schedule (duration, &LoraPhy::EndReceive, this,packet, event);
-            	  m_packetduration(packet, duration ,m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (), event->GetSpreadingFactor () );
-
-              }
-              // Make sure we don't go on searching for other ReceivePaths
-              return;
+              m_underSensitivity (packet, 0, SenderID, frequencyMHz, sf);
             }
+
+          // Since the packet is below sensitivity, it makes no sense to
+          // search for another ReceivePath
+          return;
+        }
+      else    // We have sufficient sensitivity to start receiving
+        {
+          NS_LOG_INFO ("Scheduling reception of a packet, " <<
+                       "occupying one demodulator");
+
+          // Block this resource, and remember it in the event to free it
+          NS_ASSERT (event != 0);
+          UpdateOccupancy ();
+          freePaths->second.pop_back ();
+          if (freePaths->second.empty ())
+            {
+              m_nSaturatedFrequencies++;
+            }
+          currentPath->LockOnEvent (event);
+          event->SetDemodulator (path);
+          m_occupiedReceptionPaths++;
+          m_occupancy.peakBusyPaths =
+            std::max (m_occupancy.peakBusyPaths,
+                      uint32_t (m_occupiedReceptionPaths.Get ()));
+
+          // Check if authentificated preambles are enabled
+
+          if (m_authpre == true && jammer == false)
+          {
+        	  // Schedule the end of the reception of the packet
+        	  ScheduleEndReceive (packet, event);
+        	  m_packetduration(packet, duration ,m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (), event->GetSpreadingFactor () );
+
+          }
+
+          else if (m_authpre == true && jammer == true)
+          {
+        	  // Schedule the end of the reception of the packet right after the preamble
+        	  //Simulator::Schedule (Seconds(preamble), &LoraPhy::EndReceive, this, packet, event);
+        	  //m_packetduration(packet, Seconds(preamble) ,m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (), event->GetSpreadingFactor () );
+          }
+
+          else if (m_authpre == false)
+          {
+        	  // Schedule the end of the reception of the packet
+        	  ScheduleEndReceive (packet, event);
+        	  m_packetduration(packet, duration ,m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (), event->GetSpreadingFactor () );
+
+          }
+          // Make sure we don't go on searching for other ReceivePaths
+          return;
         }
     }
   // If we get to this point, there are no demodulators we can use
@@ -365,6 +566,8 @@ GatewayLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
                " because no suitable demodulator was found at "
 			   << Simulator::Now ().GetSeconds () );
 
+  m_occupancy.drops[std::make_pair (sf, frequencyMHz)]++;
+
   // Fire the trace source
 
   if (m_device)
@@ -385,111 +588,105 @@ GatewayLoraPhy::EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Even
   m_phyRxEndTrace (packet);
 
   // Call the LoraInterferenceHelper to determine whether there was
-  // destructive interference. If the packet is correctly received, this
-  // method returns a 0.
-  // uint8_t packetDestroyed = 0;
+  // destructive interference.
+  LoraInterferenceHelper::Result result = m_interference.Evaluate (event);
+  uint8_t packetDestroyed = result.destroyed;
+  NS_LOG_INFO ("verified at " << Simulator::Now ().GetSeconds ());
+
+  NS_LOG_INFO ("Checking a packet with duration" << event->GetDuration ().GetSeconds() );
 
-  // Make a copy of the packet
+  // Collect what the gateway knows about the reception
+  LoraReceptionMetadata metadata;
+  metadata.gatewayId = m_device ? m_device->GetNode ()->GetId () : 0;
+  metadata.senderId = event->GetTransmission ()->GetSenderId ();
+  metadata.rxPowerDbm = event->GetRxPowerdBm ();
+  metadata.snir = result.sinr;
+  metadata.frequencyMHz = event->GetFrequency ();
+  metadata.sf = event->GetSpreadingFactor ();
+  uint32_t SenderID = metadata.senderId;
+
+  // The packet is shared by all the receivers of the transmission, so tag a
+  // single copy of it with the outcome, which the traces and the upper layers
+  // then share. The receive power and frequency can be useful for upper
+  // layers trying to control link quality, and reach the network server this
+  // way.
   Ptr<Packet> packetCopy = packet->Copy ();
 
   LoraTag tag;
   packetCopy->RemovePacketTag (tag);
-  uint32_t SenderID = tag.GetSenderID();
-  tag.SetGWid (m_device->GetNode ()->GetId ());
+  tag.SetGWid (metadata.gatewayId);
+  if (packetDestroyed)
+    {
+      tag.SetDestroyedBy (packetDestroyed);
+    }
+  else
+    {
+      tag.SetReceivePower (metadata.rxPowerDbm);
+      tag.SetFrequency (metadata.frequencyMHz);
+    }
   packetCopy->AddPacketTag (tag);
 
-  uint8_t packetDestroyed = m_interference.IsDestroyedByInterference (event);
-  double snir = m_interference.GetSINR (event);
-  NS_LOG_INFO ("verified at " << Simulator::Now ().GetSeconds ());
-
-  NS_LOG_INFO ("Checking a packet with duration" << event->GetDuration ().GetSeconds() );
-
   // Check whether the packet was destroyed
   if (packetDestroyed)
     {
 
-      bool OnThePreamble = m_interference.GetOnThePreamble ();
-      Time colstart = m_interference.GetColStart ();
-      Time colend = m_interference.GetColEnd ();
-	  uint8_t colsf = m_interference.GetSF ();
-
-      // Update the packet's LoraTag
-      LoraTag tag1;
-      packetCopy->RemovePacketTag (tag1);
-      tag1.SetDestroyedBy (packetDestroyed);
-      packetCopy->AddPacketTag (tag1);
+      bool OnThePreamble = result.onThePreamble;
+      Time colstart = result.colStart;
+      Time colend = result.colEnd;
+	  uint8_t colsf = result.colSf;
 
       NS_LOG_DEBUG ("Packet destroyed - collision Parameters: start time = " << colstart.GetSeconds() << " end time = " << colend.GetSeconds() << " on the preamble = " << OnThePreamble <<" Sender ID = " << SenderID << " SF = " << unsigned(colsf));
 
       // Fire the trace source
-      if (m_device)
-        {
-          m_interferedPacket (packetCopy,m_device->GetNode ()->GetId () , SenderID, colsf, event->GetFrequency (), colstart, colend, OnThePreamble);
-          m_interference.CleanParameters ();
-        }
-      else
-        {
-          m_interferedPacket (packetCopy, 0, SenderID, colsf, event->GetFrequency (), colstart, colend, OnThePreamble);
-          m_interference.CleanParameters ();
-        }
+      m_interferedPacket (packetCopy, metadata.gatewayId, SenderID, colsf, metadata.frequencyMHz, colstart, colend, OnThePreamble);
     }
   else   // Reception was correct
     {
-	  bool CE = m_interference.GetCE (); // Capture Effect ??
-      NS_LOG_INFO ("Packet with SF " << unsigned(event->GetSpreadingFactor ()) << " received correctly");
+	  bool CE = result.captureEffect; // Capture Effect ??
+      NS_LOG_INFO ("Packet with SF " << unsigned(metadata.sf) << " received correctly");
       NS_LOG_INFO ("CE ? " << CE);
 
       if (CE){
 
-    	  m_packetce (packetCopy, m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (),CE);
+    	  m_packetce (packetCopy, metadata.gatewayId, SenderID, metadata.frequencyMHz, CE);
 
       }
 
       // Fire the trace source
-      if (m_device)
+      m_successfullyReceivedPacket (packetCopy, metadata.gatewayId, SenderID, metadata.frequencyMHz, metadata.sf, metadata.snir);
+
+      // Forward the packet to the upper layer, with the metadata if it
+      // wants it
+      if (!m_rxOkMetadataCallback.IsNull ())
         {
-          m_successfullyReceivedPacket (packetCopy, m_device->GetNode ()->GetId (), SenderID, event->GetFrequency (), event->GetSpreadingFactor (), snir);
+          m_rxOkMetadataCallback (packetCopy, metadata);
         }
-      else
+      else if (!m_rxOkCallback.IsNull ())
         {
-          m_successfullyReceivedPacket (packetCopy, 0, SenderID, event->GetFrequency (), event->GetSpreadingFactor (), snir);
-        }
-
-      // Forward the packet to the upper layer
-      if (!m_rxOkCallback.IsNull ())
-        {
-
-    	  // Set the receive power and frequency of this packet in the LoraTag: this
-          // information can be useful for upper layers trying to control link
-          // quality.
-
-    	  Ptr<Packet> packetCopy1 = packetCopy->Copy ();
-
-          LoraTag tag2;
-          packetCopy1->RemovePacketTag (tag2);
-          tag2.SetReceivePower (event->GetRxPowerdBm ());
-          tag2.SetFrequency (event->GetFrequency ());
-          packetCopy1->AddPacketTag (tag2);
-
-          m_rxOkCallback (packetCopy1);
+          m_rxOkCallback (packetCopy);
         }
 
     }
 
-  // Search for the demodulator that was locked on this event to free it.
-
-  std::list< Ptr< GatewayLoraPhy::ReceptionPath > >::iterator it;
-
-  for (it = m_receptionPaths.begin (); it != m_receptionPaths.end (); ++it)
+  // Free the demodulator that was locked on this event, unless the reception
+  // paths were reset in the meantime
+  int32_t path = event->GetDemodulator ();
+  if (path >= 0 && uint32_t (path) < m_receptionPaths.size ()
+      && m_receptionPaths[path]->GetEvent () == event)
     {
-      Ptr<GatewayLoraPhy::ReceptionPath> currentPath = *it;
-
-      if (currentPath->GetEvent () == event)
+      Ptr<GatewayLoraPhy::ReceptionPath> currentPath = m_receptionPaths[path];
+      currentPath->Free ();
+      event->SetDemodulator (-1);
+
+      UpdateOccupancy ();
+      std::vector<uint32_t> &freePaths =
+        m_freeReceptionPaths[currentPath->GetFrequency ()];
+      if (freePaths.empty ())
         {
-          currentPath->Free ();
-          m_occupiedReceptionPaths--;
-          return;
+          m_nSaturatedFrequencies--;
         }
+      freePaths.push_back (path);
+      m_occupiedReceptionPaths--;
     }
 }
 
@@ -498,22 +695,8 @@ GatewayLoraPhy::IsOnFrequency (double frequencyMHz)
 {
   NS_LOG_FUNCTION (this << frequencyMHz);
 
-  // Search every demodulator to see whether there's one listening on this
-  // frequency.
-  std::list< Ptr< GatewayLoraPhy::ReceptionPath > >::iterator it;
-
-  for (it = m_receptionPaths.begin (); it != m_receptionPaths.end (); ++it)
-    {
-      Ptr<GatewayLoraPhy::ReceptionPath> currentPath = *it;
-
-      NS_LOG_DEBUG ("Current reception path is on frequency " <<
-                    currentPath->GetFrequency ());
-
-      if (currentPath->GetFrequency () == frequencyMHz)
-        {
-          return true;
-        }
-    }
-  return false;
+  // Every frequency some demodulator listens on has a free-list, even if it
+  // is empty
+  return m_freeReceptionPaths.count (frequencyMHz) > 0;
 }
 }
@@ -31,6 +31,9 @@
 #include "ns3/lora-phy.h"
 #include "ns3/traced-value.h"
 #include <list>
+#include <map>
+#include <string>
+#include <vector>
 
 using namespace std;
 
@@ -38,6 +41,29 @@ namespace ns3 {
 
 class LoraChannel;
 
+/**
+ * Statistics on the occupancy of the reception paths of a GatewayLoraPhy.
+ */
+struct ReceptionPathOccupancy
+{
+  ReceptionPathOccupancy ();
+
+  std::vector<Time> busyTime; //!< The time spent with each number of busy
+                              //!paths, indexed by the number of paths.
+  Time saturatedTime; //!< The time during which all the paths listening on
+                      //!some frequency were busy.
+  uint32_t peakBusyPaths; //!< The largest number of paths busy at once.
+  std::map<std::pair<uint8_t, double>, uint64_t> drops; //!< The packets lost
+                        //!because no path was available, by SF and
+                        //!frequency [MHz].
+};
+
+/**
+ * Allow logging of ReceptionPathOccupancy like with any other data type.
+ */
+std::ostream &operator << (std::ostream &os,
+                           const ReceptionPathOccupancy &occupancy);
+
 /**
  * Class modeling a Lora SX1301 chip.
  *
@@ -58,7 +84,9 @@ public:
   virtual ~GatewayLoraPhy();
 
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm, uint8_t sf,
-                             Time duration, double frequencyMHz);
+                             Time duration, double frequencyMHz,
+                             Ptr<const LoraInterferenceHelper::Transmission>
+                             transmission);
 
   virtual void EndReceive (Ptr<Packet> packet, Ptr<LoraInterferenceHelper::Event> event);
 
@@ -69,6 +97,10 @@ public:
 
   bool IsTransmitting (void);
 
+  /**
+   * Set the interference model by its identifier, as registered in
+   * LoraInterferenceHelper. Unknown identifiers select Pure_ALOHA.
+   */
   void SetInterferenceModel (uint8_t inter);
 
   void SetDelta (double delta);
@@ -89,6 +121,45 @@ public:
    */
   void ResetReceptionPaths (void);
 
+  /**
+   * Get the power below which incoming signals are only accounted for as
+   * background noise, if the PruneInterferers attribute is set.
+   *
+   * A signal can only destroy another one that is at most as much weaker
+   * than it as the largest value of the co-channel rejection matrix, and
+   * the gateway does not receive signals below its sensitivity, so the
+   * threshold is the lowest sensitivity minus the largest rejection value,
+   * minus the InterfererPruningMargin.
+   *
+   * \return The threshold, in dBm.
+   */
+  double GetInterfererPruningThreshold (void) const;
+
+  /**
+   * Get the number of signals that were accounted for as background noise.
+   */
+  uint64_t GetNPrunedInterferers (void) const;
+
+  /**
+   * Get the statistics on the occupancy of the reception paths, accounted
+   * until now.
+   */
+  ReceptionPathOccupancy GetReceptionPathOccupancy (void) const;
+
+  /**
+   * Set the file the occupancy statistics are appended to when the
+   * simulation is destroyed.
+   *
+   * \param filename The file, or an empty string not to write them.
+   */
+  void SetOccupancyFile (std::string filename);
+
+  /**
+   * Get the file the occupancy statistics are appended to when the
+   * simulation is destroyed.
+   */
+  std::string GetOccupancyFile (void) const;
+
   /**
    * A vector containing the sensitivities required to correctly decode
    * different spreading factors.
@@ -194,10 +265,16 @@ private:
   };
 
   /**
-   * A list containing the various parallel receivers that are managed by this
-   * Gateway.
+   * A vector containing the various parallel receivers that are managed by
+   * this Gateway. The index of a path is stored in the event it is locked on.
+   */
+  std::vector<Ptr<ReceptionPath> > m_receptionPaths;
+
+  /**
+   * The indices of the available reception paths, for each frequency [MHz]
+   * some path listens on.
    */
-  std::list<Ptr<ReceptionPath> > m_receptionPaths;
+  std::map<double, std::vector<uint32_t> > m_freeReceptionPaths;
 
   /**
    * The number of occupied reception paths.
@@ -213,7 +290,56 @@ private:
 
   TracedCallback<Ptr<const Packet>, uint32_t, uint32_t, double, uint8_t> m_noMoreDemodulators;
 
+  /**
+   * Account the time since the last change of the occupancy of the reception
+   * paths to their current state. This is called before every change.
+   */
+  void UpdateOccupancy (void);
+
+  /**
+   * Append the occupancy statistics to m_occupancyFile.
+   */
+  void DumpOccupancy (void);
+
+  /**
+   * The occupancy statistics, accounted until m_occupancyTick.
+   */
+  ReceptionPathOccupancy m_occupancy;
+
+  /**
+   * The time of the last change of the occupancy, in time steps.
+   */
+  int64_t m_occupancyTick;
+
+  /**
+   * The number of frequencies whose reception paths are all busy.
+   */
+  uint32_t m_nSaturatedFrequencies;
+
+  /**
+   * The file the occupancy statistics are appended to at the end of the
+   * simulation, if any.
+   */
+  std::string m_occupancyFile;
+
+  /**
+   * Whether DumpOccupancy was scheduled.
+   */
+  bool m_occupancyDumpScheduled;
+
   bool m_isTransmitting; //!< Flag indicating whether a transmission is going on
+
+  /**
+   * Whether signals below GetInterfererPruningThreshold are accounted for as
+   * background noise instead of being stored as events.
+   */
+  bool m_pruneInterferers;
+
+  /**
+   * How far below the weakest harmful signal the pruning threshold is, to
+   * leave room for the accumulation of many pruned signals [dB].
+   */
+  double m_interfererPruningMarginDb;
 };
 
 } /* namespace ns3 */
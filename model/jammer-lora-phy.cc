@@ -111,6 +111,7 @@ JammerLoraPhy::SetType (double type)
 {
   m_jamType = type;
   NS_LOG_INFO ("Jammer Type: " << type);
+  UpdateSubscription ();
 }
 
 void
@@ -263,7 +264,9 @@ JammerLoraPhy::DirectSend (Ptr<Packet> packet, LoraTxParameters txParams,
 
 void
 JammerLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                                uint8_t sf, Time duration, double frequencyMHz)
+                                uint8_t sf, Time duration, double frequencyMHz,
+                                Ptr<const LoraInterferenceHelper::Transmission>
+                                transmission)
 {
   LoraTxParameters txParams;
   Time jamduration = GetReceiveWindowTime (txParams,1);
@@ -272,12 +275,10 @@ JammerLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
   NS_LOG_INFO ("Jammer receive");
 
 
-  // Update the packet's LoraTag
-  LoraTag tag;
-  packet->RemovePacketTag (tag);
-  uint8_t jamm = tag.GetJammer();
-  uint32_t SenderID = tag.GetSenderID();
-  packet->AddPacketTag (tag);
+  // Read the metadata from the transmission, since the packet is shared by
+  // all receivers
+  uint8_t jamm = transmission->IsJammer ();
+  uint32_t SenderID = transmission->GetSenderId ();
 
 
 
@@ -290,7 +291,7 @@ JammerLoraPhy::StartReceive (Ptr<Packet> packet, double rxPowerDbm,
   // still incoming.
 
   Ptr<LoraInterferenceHelper::Event> event;
-  //event = m_interference.Add (duration, rxPowerDbm, sf, packet, frequencyMHz);
+  //event = m_interference.Add (transmission, rxPowerDbm);
 
   // Switch on the current PHY state
   switch (m_state)
@@ -460,6 +461,7 @@ void
 JammerLoraPhy::SetFrequency (double frequencyMHz)
 {
   m_frequency = frequencyMHz;
+  UpdateSubscription ();
 }
 
 void
@@ -479,6 +481,7 @@ JammerLoraPhy::SwitchToStandby (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
   m_state = STANDBY;
+  UpdateSubscription ();
   NS_LOG_FUNCTION (this << "STB" << Simulator::Now ().GetSeconds ());
 }
 
@@ -490,6 +493,7 @@ JammerLoraPhy::SwitchToRx (void)
   NS_ASSERT (m_state == STANDBY);
 
   m_state = RX;
+  UpdateSubscription ();
   NS_LOG_FUNCTION (this << "RX" << Simulator::Now ().GetSeconds ());
 }
 
@@ -500,10 +504,33 @@ JammerLoraPhy::SwitchToTx (void)
 
   NS_ASSERT (m_state != RX);
   m_state = TX;
+  UpdateSubscription ();
   NS_LOG_FUNCTION (this << "TX" << Simulator::Now ().GetSeconds ());
 
 }
 
+void
+JammerLoraPhy::UpdateSubscription (void)
+{
+  // A jammer of type 2 only reacts to the transmissions on its frequency
+  std::set<double> frequencies;
+  if (m_jamType == 2)
+    {
+      frequencies.insert (m_frequency);
+    }
+  SetListeningFrequencies (frequencies);
+
+  // Packets are dropped in TX and RX
+  if (m_state != STANDBY)
+    {
+      Unsubscribe ();
+    }
+  else
+    {
+      Subscribe ();
+    }
+}
+
 JammerLoraPhy::State
 JammerLoraPhy::GetState (void)
 {
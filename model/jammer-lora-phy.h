@@ -98,7 +98,9 @@ public:
 
   // Implementation of LoraPhy's pure virtual functions
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm,
-                             uint8_t sf, Time duration, double frequencyMHz);
+                             uint8_t sf, Time duration, double frequencyMHz,
+                             Ptr<const LoraInterferenceHelper::Transmission>
+                             transmission);
 
   // Implementation of LoraPhy's pure virtual functions
   // virtual void EndReceive (Ptr<Packet> packet,
@@ -200,6 +202,12 @@ private:
    */
   void SwitchToTx (void);
 
+  /**
+   * Subscribe to the channel in STANDBY only, and only listen to the target
+   * frequency if the jammer reacts to the transmissions on that frequency.
+   */
+  void UpdateSubscription (void);
+
   /**
    * Trace source for when a packet is lost because it was using a SF different from
    * the one this JammerLoraPhy was configured to listen for.
@@ -26,10 +26,22 @@
 #include "ns3/object-factory.h"
 #include "ns3/packet.h"
 #include "ns3/simulator.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/string.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/constant-position-mobility-model.h"
 //#include "ns3/end-device-lora-phy.h"
 //#include "ns3/jammer-lora-phy.h"
 //#include "ns3/gateway-lora-phy.h"
 #include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
 
 namespace ns3 {
 
@@ -37,6 +49,140 @@ NS_LOG_COMPONENT_DEFINE ("LoraChannel");
 
 NS_OBJECT_ENSURE_REGISTERED (LoraChannel);
 
+/**
+ * A pool of threads that split a job on a range of indices.
+ *
+ * The threads wait for jobs between calls to Run, so that they are only
+ * created once.
+ */
+class LoraChannel::PropagationWorkers
+{
+public:
+  /**
+   * A job, called on a range [begin, end) of indices.
+   */
+  typedef std::function<void (uint32_t, uint32_t)> Job;
+
+  PropagationWorkers (uint32_t nThreads);
+  ~PropagationWorkers ();
+
+  /**
+   * Get the number of worker threads.
+   */
+  uint32_t GetNThreads (void) const;
+
+  /**
+   * Run a job on the indices [0, size), and return when it is done.
+   *
+   * The range is split in equal parts among the worker threads and the
+   * calling thread.
+   */
+  void Run (uint32_t size, const Job &job);
+
+private:
+  /**
+   * The loop of a worker thread.
+   *
+   * \param w The index of the thread, which selects its part of the range.
+   */
+  void Work (uint32_t w);
+
+  const uint32_t m_nThreads; //!< The number of worker threads.
+  std::vector<std::thread> m_threads; //!< The worker threads.
+  std::mutex m_mutex; //!< Protects the members below.
+  std::condition_variable m_start; //!< Signals a new job or the end.
+  std::condition_variable m_done; //!< Signals that the workers are done.
+  const Job *m_job; //!< The current job.
+  uint32_t m_size; //!< The size of the range of the current job.
+  uint64_t m_round; //!< The number of jobs run so far.
+  uint32_t m_pending; //!< The workers that did not finish the current job.
+  bool m_stop; //!< Whether the workers must exit.
+};
+
+LoraChannel::PropagationWorkers::PropagationWorkers (uint32_t nThreads) :
+  m_nThreads (nThreads),
+  m_job (0),
+  m_size (0),
+  m_round (0),
+  m_pending (0),
+  m_stop (false)
+{
+  for (uint32_t w = 0; w < m_nThreads; w++)
+    {
+      m_threads.push_back (std::thread (&PropagationWorkers::Work, this, w));
+    }
+}
+
+LoraChannel::PropagationWorkers::~PropagationWorkers ()
+{
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_stop = true;
+  }
+  m_start.notify_all ();
+
+  for (uint32_t w = 0; w < m_threads.size (); w++)
+    {
+      m_threads[w].join ();
+    }
+}
+
+uint32_t
+LoraChannel::PropagationWorkers::GetNThreads (void) const
+{
+  return m_nThreads;
+}
+
+void
+LoraChannel::PropagationWorkers::Run (uint32_t size, const Job &job)
+{
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_job = &job;
+    m_size = size;
+    m_pending = m_nThreads;
+    m_round++;
+  }
+  m_start.notify_all ();
+
+  // The calling thread takes the last part
+  job (uint64_t (size) * m_nThreads / (m_nThreads + 1), size);
+
+  std::unique_lock<std::mutex> lock (m_mutex);
+  m_done.wait (lock, [this] { return m_pending == 0; });
+}
+
+void
+LoraChannel::PropagationWorkers::Work (uint32_t w)
+{
+  uint64_t round = 0;
+  while (true)
+    {
+      const Job *job;
+      uint32_t size;
+      {
+        std::unique_lock<std::mutex> lock (m_mutex);
+        m_start.wait (lock, [this, round] { return m_stop || m_round != round; });
+        if (m_stop)
+          {
+            return;
+          }
+        round = m_round;
+        job = m_job;
+        size = m_size;
+      }
+
+      (*job) (uint64_t (size) * w / (m_nThreads + 1),
+              uint64_t (size) * (w + 1) / (m_nThreads + 1));
+
+      std::lock_guard<std::mutex> lock (m_mutex);
+      if (--m_pending == 0)
+        {
+          m_done.notify_one ();
+        }
+    }
+}
+
 TypeId
 LoraChannel::GetTypeId (void)
 {
@@ -54,26 +200,122 @@ LoraChannel::GetTypeId (void)
                    PointerValue (),
                    MakePointerAccessor (&LoraChannel::m_delay),
                    MakePointerChecker<PropagationDelayModel> ())
+    .AddAttribute ("NegligibleRxPower",
+                   "Received power [dBm] below which a transmission is not "
+                   "delivered to a PHY. Receivers farther than the distance "
+                   "at which the loss model yields this power are skipped "
+                   "without computing their power. This assumes that the "
+                   "loss model is deterministic and does not decrease with "
+                   "distance. The default disables culling.",
+                   DoubleValue (-std::numeric_limits<double>::infinity ()),
+                   MakeDoubleAccessor (&LoraChannel::m_negligibleRxPowerDbm),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("CullingCellSize",
+                   "The size [m] of the cells of the grid used to find the "
+                   "PHYs close to a transmitter.",
+                   DoubleValue (1000),
+                   MakeDoubleAccessor (&LoraChannel::m_cellSize),
+                   MakeDoubleChecker<double> (1))
+    .AddAttribute ("CacheLinks",
+                   "Whether to compute the loss and delay between two PHYs "
+                   "only once, until one of them moves. This assumes that "
+                   "the loss model is deterministic and that the loss does "
+                   "not depend on the transmission power.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoraChannel::m_cacheLinks),
+                   MakeBooleanChecker ())
+    .AddAttribute ("DenseLinkLimit",
+                   "The largest number of PHYs for which the links are "
+                   "cached in a dense matrix. Above it, the links are cached "
+                   "in a hash table as they are used.",
+                   UintegerValue (1000),
+                   MakeUintegerAccessor (&LoraChannel::m_denseLinkLimit),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("CoalesceDeliveries",
+                   "Whether the deliveries of transmissions that reach PHYs "
+                   "at the same time share a single scheduler event. That "
+                   "event runs in the context of the node of the first "
+                   "sender, so the receptions start in that context rather "
+                   "than in the receiving node's. The end of each reception "
+                   "is scheduled in the context of the receiving node.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoraChannel::m_coalesceDeliveries),
+                   MakeBooleanChecker ())
+    .AddAttribute ("CoalescingTolerance",
+                   "When deliveries are coalesced, propagation delays are "
+                   "rounded down to a multiple of this time, so that "
+                   "receivers at similar distances share an event. The "
+                   "default is the nanosecond resolution of the simulator, "
+                   "which does not change delivery times.",
+                   TimeValue (NanoSeconds (1)),
+                   MakeTimeAccessor (&LoraChannel::m_coalescingTolerance),
+                   MakeTimeChecker (NanoSeconds (1)))
+    .AddAttribute ("PropagationThreads",
+                   "The number of worker threads computing the received "
+                   "power and delay of a transmission at its receivers, in "
+                   "addition to the simulation thread. Only a single "
+                   "LogDistancePropagationLossModel with a "
+                   "ConstantSpeedPropagationDelayModel and no link cache "
+                   "is supported, and gives the same results as the serial "
+                   "computation. 0 disables the worker threads.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&LoraChannel::m_propagationThreads),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("ParallelPropagationThreshold",
+                   "The smallest number of receivers for which the worker "
+                   "threads are used.",
+                   UintegerValue (1000),
+                   MakeUintegerAccessor
+                     (&LoraChannel::m_parallelPropagationThreshold),
+                   MakeUintegerChecker<uint32_t> ())
     .AddTraceSource ("PacketSent",
-                     "Trace source fired whenever a packet goes out on the channel",
+                     "Trace source fired once whenever a packet goes out on "
+                     "the channel",
                      MakeTraceSourceAccessor (&LoraChannel::m_packetSent),
                      "ns3::Packet::TracedCallback");
   return tid;
 }
 
-LoraChannel::LoraChannel ()
+LoraChannel::LoraChannel () :
+  m_negligibleRxPowerDbm (-std::numeric_limits<double>::infinity ()),
+  m_cellSize (1000),
+  m_positionsValid (false),
+  m_gridValid (false),
+  m_cacheLinks (false),
+  m_denseLinkLimit (1000),
+  m_linksValid (false),
+  m_coalesceDeliveries (false),
+  m_coalescingTolerance (NanoSeconds (1)),
+  m_propagationThreads (0),
+  m_parallelPropagationThreshold (1000),
+  m_workers (0)
 {
 }
 
 LoraChannel::~LoraChannel ()
 {
+  // The mobility models may outlive the channel
+  UntrackMobility ();
   m_phyList.clear ();
+  delete m_workers;
 }
 
 LoraChannel::LoraChannel (Ptr<PropagationLossModel> loss,
                           Ptr<PropagationDelayModel> delay) :
+  m_negligibleRxPowerDbm (-std::numeric_limits<double>::infinity ()),
+  m_cellSize (1000),
+  m_positionsValid (false),
+  m_gridValid (false),
+  m_cacheLinks (false),
+  m_denseLinkLimit (1000),
+  m_linksValid (false),
   m_loss (loss),
-  m_delay (delay)
+  m_delay (delay),
+  m_coalesceDeliveries (false),
+  m_coalescingTolerance (NanoSeconds (1)),
+  m_propagationThreads (0),
+  m_parallelPropagationThreshold (1000),
+  m_workers (0)
 {
 }
 
@@ -84,6 +326,11 @@ LoraChannel::Add (Ptr<LoraPhy> phy)
 
   // Add the new phy to the vector
   m_phyList.push_back (phy);
+  m_phyIndex[PeekPointer (phy)] = m_phyList.size () - 1;
+  AddToFrequencyLists (m_phyList.size () - 1);
+  m_positionsValid = false;
+  m_gridValid = false;
+  m_linksValid = false;
 }
 
 void
@@ -93,6 +340,87 @@ LoraChannel::Remove (Ptr<LoraPhy> phy)
 
   // Remove the phy from the vector
   m_phyList.erase (find (m_phyList.begin (), m_phyList.end (), phy));
+  m_positionsValid = false;
+  m_gridValid = false;
+  m_linksValid = false;
+
+  // The PHYs after the removed one changed index
+  RebuildFrequencyLists ();
+}
+
+void
+LoraChannel::UpdateListeningFrequencies (Ptr<LoraPhy> phy)
+{
+  NS_LOG_FUNCTION (this << phy);
+
+  std::unordered_map<const LoraPhy *, uint32_t>::const_iterator it =
+    m_phyIndex.find (PeekPointer (phy));
+  if (it == m_phyIndex.end ())
+    {
+      return;
+    }
+
+  RemoveFromFrequencyLists (it->second);
+  AddToFrequencyLists (it->second);
+}
+
+void
+LoraChannel::AddToFrequencyLists (uint32_t i)
+{
+  const std::set<double> &frequencies = m_phyList[i]->GetListeningFrequencies ();
+
+  if (frequencies.empty ())
+    {
+      m_allFrequenciesList.insert (std::lower_bound (m_allFrequenciesList.begin (),
+                                                     m_allFrequenciesList.end (),
+                                                     i), i);
+      return;
+    }
+
+  std::set<double>::const_iterator f;
+  for (f = frequencies.begin (); f != frequencies.end (); f++)
+    {
+      std::vector<uint32_t> &list = m_frequencyLists[*f];
+      list.insert (std::lower_bound (list.begin (), list.end (), i), i);
+    }
+}
+
+void
+LoraChannel::RemoveFromFrequencyLists (uint32_t i)
+{
+  std::vector<uint32_t>::iterator it =
+    std::lower_bound (m_allFrequenciesList.begin (),
+                      m_allFrequenciesList.end (), i);
+  if (it != m_allFrequenciesList.end () && *it == i)
+    {
+      m_allFrequenciesList.erase (it);
+    }
+
+  std::map<double, std::vector<uint32_t> >::iterator f;
+  for (f = m_frequencyLists.begin (); f != m_frequencyLists.end (); f++)
+    {
+      it = std::lower_bound (f->second.begin (), f->second.end (), i);
+      if (it != f->second.end () && *it == i)
+        {
+          f->second.erase (it);
+        }
+    }
+}
+
+void
+LoraChannel::RebuildFrequencyLists (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_phyIndex.clear ();
+  m_frequencyLists.clear ();
+  m_allFrequenciesList.clear ();
+
+  for (uint32_t j = 0; j < m_phyList.size (); j++)
+    {
+      m_phyIndex[PeekPointer (m_phyList[j])] = j;
+      AddToFrequencyLists (j);
+    }
 }
 
 uint32_t
@@ -101,6 +429,20 @@ LoraChannel::GetNDevices (void) const
   return m_phyList.size ();
 }
 
+const LoraChannelCounters &
+LoraChannel::GetCounters (void) const
+{
+  return m_counters;
+}
+
+void
+LoraChannel::ResetCounters (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_counters = LoraChannelCounters ();
+}
+
 Ptr<NetDevice>
 LoraChannel::GetDevice (uint32_t i) const
 {
@@ -120,65 +462,428 @@ LoraChannel::Send (Ptr< LoraPhy > sender, Ptr< Packet > packet,
 
   NS_ASSERT (senderMobility != 0); // Make sure it's available
 
-  NS_LOG_INFO ("Starting cycle over all " << m_phyList.size () << " PHYs");
+  // Describe the transmission once: receivers only add the power they see
+  Ptr<LoraInterferenceHelper::Transmission> transmission =
+    Create<LoraInterferenceHelper::Transmission> (duration, txParams.sf, packet,
+                                                  frequencyMHz);
+
+  // The index of the sender, to look up the links in the cache
+  uint32_t senderIndex = m_phyList.size ();
+  if ((m_cacheLinks || m_linkTable != 0)
+      && m_phyIndex.count (PeekPointer (sender)))
+    {
+      senderIndex = m_phyIndex.find (PeekPointer (sender))->second;
+    }
+
+  // Remember the transmission while it is on the air, for the PHYs that
+  // subscribe before it ends
+  ForgetOldTransmissions ();
+  OnAirTransmission onAirTransmission;
+  onAirTransmission.sender = sender;
+  onAirTransmission.senderMobility = senderMobility;
+  onAirTransmission.txPowerDbm = txPowerDbm;
+  onAirTransmission.packet = packet;
+  onAirTransmission.transmission = transmission;
+  onAirTransmission.start = Simulator::Now ();
+  m_onAir.push_back (onAirTransmission);
+  std::vector<const LoraPhy *> &delivered = m_onAir.back ().delivered;
+
+  // Only consider the PHYs that listen to the frequency and can hear this
+  // transmission above the negligible power
+  GetReceivers (senderMobility, txPowerDbm, frequencyMHz, m_receivers);
+
+  NS_LOG_INFO ("Starting cycle over " << m_receivers.size () << " of " <<
+               m_phyList.size () << " PHYs");
   NS_LOG_INFO ("Sender mobility: " << senderMobility->GetPosition ());
 
-  // Cycle over all registered PHYs
-  uint32_t j = 0;
-  std::vector<Ptr<LoraPhy> >::const_iterator i;
-  for (i = m_phyList.begin (); i != m_phyList.end (); i++, j++)
+  // Do not deliver to the sender, nor to the PHYs that are not listening
+  uint32_t nReceivers = 0;
+  for (uint32_t k = 0; k < m_receivers.size (); k++)
     {
-      // Do not deliver to the sender (*i is the current PHY)
-      if (sender != (*i))
+      uint32_t j = m_receivers[k];
+      if (sender != m_phyList[j] && m_phyList[j]->IsSubscribed (frequencyMHz))
         {
-          // Get the receiver's mobility model
-          Ptr<MobilityModel> receiverMobility = (*i)->GetMobility ()->
-            GetObject<MobilityModel> ();
+          m_receivers[nReceivers++] = j;
+        }
+    }
+  m_receivers.resize (nReceivers);
+
+  // Compute delay and received power for all the receivers at once if the
+  // models allow it, or using the link cache or the models
+  m_rxPowersDbm.resize (nReceivers);
+  m_delays.resize (nReceivers);
+  if (!PropagateWithKernel (senderMobility, txPowerDbm))
+    {
+      for (uint32_t k = 0; k < nReceivers; k++)
+        {
+          Ptr<MobilityModel> receiverMobility = m_phyList[m_receivers[k]]->
+            GetMobility ()->GetObject<MobilityModel> ();
+          Propagate (senderIndex, m_receivers[k], senderMobility,
+                     receiverMobility, txPowerDbm, m_rxPowersDbm[k],
+                     m_delays[k]);
+        }
+    }
 
-          NS_LOG_INFO ("Receiver mobility: " <<
-                       receiverMobility->GetPosition ());
+  // Cycle over the receivers
+  for (uint32_t k = 0; k < nReceivers; k++)
+    {
+      uint32_t j = m_receivers[k];
 
-          // Compute delay using the delay model
-          Time delay = m_delay->GetDelay (senderMobility, receiverMobility);
+      NS_LOG_INFO ("Receiver mobility: " << m_phyList[j]->GetMobility ()->
+                   GetObject<MobilityModel> ()->GetPosition ());
 
-          // Compute received power using the loss model
-          double rxPowerDbm = GetRxPower (txPowerDbm, senderMobility,
-                                          receiverMobility);
+      NS_LOG_DEBUG ("Propagation: txPower=" << txPowerDbm <<
+                    "dbm, rxPower=" << m_rxPowersDbm[k] << "dbm, " <<
+                    "distance=" << senderMobility->GetDistanceFrom
+                      (m_phyList[j]->GetMobility ()->GetObject<MobilityModel> ()) <<
+                    "m, delay=" << m_delays[k]);
 
-          NS_LOG_DEBUG ("Propagation: txPower=" << txPowerDbm <<
-                        "dbm, rxPower=" << rxPowerDbm << "dbm, " <<
-                        "distance=" << senderMobility->GetDistanceFrom (receiverMobility) <<
-                        "m, delay=" << delay);
+      // Create the parameters object based on the calculations above
+      LoraChannelParameters parameters;
+      parameters.rxPowerDbm = m_rxPowersDbm[k];
+      parameters.sf = txParams.sf;
+      parameters.duration = duration;
+      parameters.frequencyMHz = frequencyMHz;
+      parameters.transmission = transmission;
 
-          // Get the id of the destination PHY to correctly format the context
-          Ptr<NetDevice> dstNetDevice = m_phyList[j]->GetDevice ();
-          uint32_t dstNode = 0;
-          if (dstNetDevice != 0)
-            {
-              NS_LOG_INFO ("Getting node index from NetDevice, since it exists");
-              dstNode = dstNetDevice->GetNode ()->GetId ();
-              NS_LOG_DEBUG ("dstNode = " << dstNode);
-            }
-          else
-            {
-              NS_LOG_INFO ("No net device connected to the PHY, using context 0");
-            }
+      // Schedule the receive event
+      Deliver (j, packet, parameters, m_delays[k]);
+      delivered.push_back (PeekPointer (m_phyList[j]));
+    }
+
+  m_counters.transmissions++;
+  m_counters.deliveriesCulled += m_phyList.size () - nReceivers -
+    m_phyIndex.count (PeekPointer (sender));
+  m_counters.bytes[std::make_pair (txParams.sf, frequencyMHz)] +=
+    packet->GetSize ();
+
+  m_packetSent (packet);
+}
+
+bool
+LoraChannel::GetLogDistanceKernel (LogDistanceKernel &kernel) const
+{
+  Ptr<LogDistancePropagationLossModel> loss =
+    DynamicCast<LogDistancePropagationLossModel> (m_loss);
+  Ptr<ConstantSpeedPropagationDelayModel> delay =
+    DynamicCast<ConstantSpeedPropagationDelayModel> (m_delay);
+  if (loss == 0 || delay == 0 || loss->GetNext () != 0)
+    {
+      return false;
+    }
+
+  DoubleValue value;
+  kernel.exponent = loss->GetPathLossExponent ();
+  loss->GetAttribute ("ReferenceDistance", value);
+  kernel.referenceDistance = value.Get ();
+  loss->GetAttribute ("ReferenceLoss", value);
+  kernel.referenceLoss = value.Get ();
+  kernel.speed = delay->GetSpeed ();
+  return true;
+}
+
+/**
+ * Compute the received power and the delay at a range of receivers with a
+ * LoraChannel::LogDistanceKernel.
+ *
+ * The operations are those of LogDistancePropagationLossModel::CalcRxPower and
+ * ConstantSpeedPropagationDelayModel::GetDelay, in the same order, so that the
+ * results are identical. They are split in passes over the coordinates of the
+ * receivers, without virtual calls. They are not vectorized: std::sqrt and
+ * std::log10 may set errno, and a vector log10 would not round as std::log10
+ * does, so the results would differ from those of the models.
+ */
+static void
+ComputeLogDistance (double exponent, double referenceDistance,
+                    double referenceLoss, double speed, Vector sender,
+                    const double *x, const double *y, const double *z,
+                    double txPowerDbm, double *rxPowersDbm,
+                    double *delaysSeconds, uint32_t begin, uint32_t end)
+{
+  // The distances are kept in delaysSeconds until the last pass
+  double *distances = delaysSeconds;
+  for (uint32_t k = begin; k < end; k++)
+    {
+      double dx = x[k] - sender.x;
+      double dy = y[k] - sender.y;
+      double dz = z[k] - sender.z;
+      distances[k] = std::sqrt (dx * dx + dy * dy + dz * dz);
+    }
+
+  double closeRxPowerDbm = txPowerDbm - referenceLoss;
+  for (uint32_t k = begin; k < end; k++)
+    {
+      double pathLossDb = 10 * exponent *
+        std::log10 (distances[k] / referenceDistance);
+      double rxc = -referenceLoss - pathLossDb;
+      rxPowersDbm[k] = distances[k] <= referenceDistance ?
+        closeRxPowerDbm : txPowerDbm + rxc;
+    }
+
+  for (uint32_t k = begin; k < end; k++)
+    {
+      delaysSeconds[k] = distances[k] / speed;
+    }
+}
+
+bool
+LoraChannel::PropagateWithKernel (Ptr<MobilityModel> senderMobility,
+                                  double txPowerDbm) const
+{
+  uint32_t n = m_receivers.size ();
+
+  // The links of the cache are cheaper to look up
+  LogDistanceKernel kernel;
+  if (n == 0 || m_cacheLinks || m_linkTable != 0 ||
+      !GetLogDistanceKernel (kernel))
+    {
+      return false;
+    }
+
+  NS_LOG_FUNCTION (this << senderMobility << txPowerDbm << n);
+
+  // Read the positions on the simulation thread, since mobility models may
+  // update their state when queried. Those of the receivers are only read
+  // again after a CourseChange, as for the culling grid.
+  Vector sender = senderMobility->GetPosition ();
+  if (!m_positionsValid)
+    {
+      BuildPositions ();
+    }
+  m_receiverX.resize (n);
+  m_receiverY.resize (n);
+  m_receiverZ.resize (n);
+  for (uint32_t k = 0; k < n; k++)
+    {
+      uint32_t j = m_receivers[k];
+      m_receiverX[k] = m_positionX[j];
+      m_receiverY[k] = m_positionY[j];
+      m_receiverZ[k] = m_positionZ[j];
+    }
+  m_delaysSeconds.resize (n);
+
+  const double *x = &m_receiverX[0];
+  const double *y = &m_receiverY[0];
+  const double *z = &m_receiverZ[0];
+  double *rxPowersDbm = &m_rxPowersDbm[0];
+  double *delaysSeconds = &m_delaysSeconds[0];
+
+  // Worker threads cannot call the models, which are not thread safe, but
+  // they can run the kernel
+  if (m_propagationThreads > 0 && n >= m_parallelPropagationThreshold)
+    {
+      if (m_workers == 0 || m_workers->GetNThreads () != m_propagationThreads)
+        {
+          delete m_workers;
+          m_workers = new PropagationWorkers (m_propagationThreads);
+        }
+
+      m_workers->Run (n, [&] (uint32_t begin, uint32_t end)
+                      {
+                        ComputeLogDistance (kernel.exponent,
+                                            kernel.referenceDistance,
+                                            kernel.referenceLoss, kernel.speed,
+                                            sender, x, y, z, txPowerDbm,
+                                            rxPowersDbm, delaysSeconds, begin,
+                                            end);
+                      });
+    }
+  else
+    {
+      ComputeLogDistance (kernel.exponent, kernel.referenceDistance,
+                          kernel.referenceLoss, kernel.speed, sender, x, y, z,
+                          txPowerDbm, rxPowersDbm, delaysSeconds, 0, n);
+    }
+
+  // Time objects are only created on the simulation thread
+  for (uint32_t k = 0; k < n; k++)
+    {
+      m_delays[k] = Seconds (m_delaysSeconds[k]);
+      if (m_delays[k] > m_maxDelay)
+        {
+          m_maxDelay = m_delays[k];
+        }
+    }
+
+  return true;
+}
+
+void
+LoraChannel::Propagate (uint32_t senderIndex, uint32_t receiverIndex,
+                        Ptr<MobilityModel> senderMobility,
+                        Ptr<MobilityModel> receiverMobility,
+                        double txPowerDbm, double &rxPowerDbm,
+                        Time &delay) const
+{
+  if (senderIndex < m_phyList.size ())
+    {
+      Link link = GetLink (senderIndex, receiverIndex, senderMobility,
+                           receiverMobility);
+      delay = TimeStep (link.delay);
+      rxPowerDbm = txPowerDbm - link.lossDb;
+    }
+  else
+    {
+      delay = m_delay->GetDelay (senderMobility, receiverMobility);
+      rxPowerDbm = GetRxPower (txPowerDbm, senderMobility, receiverMobility);
+    }
+
+  if (delay > m_maxDelay)
+    {
+      m_maxDelay = delay;
+    }
+}
+
+void
+LoraChannel::Deliver (uint32_t i, Ptr<Packet> packet,
+                      LoraChannelParameters parameters, Time delay) const
+{
+  m_counters.deliveriesScheduled++;
+
+  if (m_coalesceDeliveries)
+    {
+      int64_t tolerance = m_coalescingTolerance.GetTimeStep ();
+      int64_t delayTicks = (delay.GetTimeStep () / tolerance) * tolerance;
+      int64_t tick = Simulator::Now ().GetTimeStep () + delayTicks;
+
+      std::vector<PendingDelivery> &batch = m_pendingDeliveries[tick];
+
+      // Only the first delivery of a batch needs a scheduler event. It keeps
+      // the context of the sender, since a single event cannot switch to
+      // the context of each receiver.
+      if (batch.empty ())
+        {
+          Simulator::Schedule (TimeStep (delayTicks),
+                               &LoraChannel::ReceiveBatch, this, tick);
+        }
+
+      PendingDelivery delivery;
+      delivery.i = i;
+      delivery.packet = packet;
+      delivery.parameters = parameters;
+      batch.push_back (delivery);
+      return;
+    }
+
+  // Get the id of the destination PHY to correctly format the context
+  uint32_t dstNode = GetContext (m_phyList[i]);
+
+  NS_LOG_INFO ("Scheduling reception of the packet");
+  Simulator::ScheduleWithContext (dstNode, delay, &LoraChannel::Receive,
+                                  this, i, packet, parameters);
+}
+
+uint32_t
+LoraChannel::GetContext (Ptr<LoraPhy> phy)
+{
+  Ptr<NetDevice> netDevice = phy->GetDevice ();
+  uint32_t node = 0;
+  if (netDevice != 0)
+    {
+      NS_LOG_INFO ("Getting node index from NetDevice, since it exists");
+      node = netDevice->GetNode ()->GetId ();
+      NS_LOG_DEBUG ("node = " << node);
+    }
+  else
+    {
+      NS_LOG_INFO ("No net device connected to the PHY, using context 0");
+    }
+  return node;
+}
+
+void
+LoraChannel::ForgetOldTransmissions (void) const
+{
+  // A transmission can be forgotten when it left the air at all the PHYs
+  Time now = Simulator::Now ();
+  while (!m_onAir.empty () &&
+         m_onAir.front ().start + m_onAir.front ().transmission->GetDuration () +
+         m_maxDelay < now)
+    {
+      m_onAir.pop_front ();
+    }
+}
+
+void
+LoraChannel::Replay (Ptr<LoraPhy> phy) const
+{
+  NS_LOG_FUNCTION (this << phy);
+
+  ForgetOldTransmissions ();
+
+  std::unordered_map<const LoraPhy *, uint32_t>::const_iterator index =
+    m_phyIndex.find (PeekPointer (phy));
+  if (index == m_phyIndex.end ())
+    {
+      return;
+    }
+  uint32_t j = index->second;
+
+  Ptr<MobilityModel> receiverMobility = phy->GetMobility ()->
+    GetObject<MobilityModel> ();
+  Time now = Simulator::Now ();
+
+  std::deque<OnAirTransmission>::iterator it;
+  for (it = m_onAir.begin (); it != m_onAir.end (); it++)
+    {
+      Ptr<const LoraInterferenceHelper::Transmission> transmission =
+        it->transmission;
+
+      if (it->sender == phy || !phy->IsSubscribed (transmission->GetFrequency ())
+          || std::find (it->delivered.begin (), it->delivered.end (),
+                        PeekPointer (phy)) != it->delivered.end ())
+        {
+          continue;
+        }
+
+      uint32_t senderIndex = m_phyList.size ();
+      if ((m_cacheLinks || m_linkTable != 0)
+          && m_phyIndex.count (PeekPointer (it->sender)))
+        {
+          senderIndex = m_phyIndex.find (PeekPointer (it->sender))->second;
+        }
+
+      Time delay;
+      double rxPowerDbm;
+      Propagate (senderIndex, j, it->senderMobility, receiverMobility,
+                 it->txPowerDbm, rxPowerDbm, delay);
+
+      // Skip the transmissions that culling would not deliver
+      if (rxPowerDbm < m_negligibleRxPowerDbm)
+        {
+          continue;
+        }
+
+      Time arrival = it->start + delay;
+      Time end = arrival + transmission->GetDuration ();
+      if (end <= now)
+        {
+          continue;
+        }
+
+      it->delivered.push_back (PeekPointer (phy));
+
+      if (arrival >= now)
+        {
+          // The transmission did not reach the PHY yet: deliver it as usual
+          NS_LOG_DEBUG ("Delivering transmission " << transmission->GetId () <<
+                        " in " << arrival - now);
 
-          // Create the parameters object based on the calculations above
           LoraChannelParameters parameters;
           parameters.rxPowerDbm = rxPowerDbm;
-          parameters.sf = txParams.sf;
-          parameters.duration = duration;
-          parameters.frequencyMHz = frequencyMHz;
-
-          // Schedule the receive event
-          NS_LOG_INFO ("Scheduling reception of the packet");
-          Simulator::ScheduleWithContext (dstNode, delay, &LoraChannel::Receive,
-                                          this, j, packet, parameters);
+          parameters.sf = transmission->GetSpreadingFactor ();
+          parameters.duration = transmission->GetDuration ();
+          parameters.frequencyMHz = transmission->GetFrequency ();
+          parameters.transmission = transmission;
+          Deliver (j, it->packet, parameters, arrival - now);
+        }
+      else
+        {
+          // The PHY missed the beginning: it can only be interfered with
+          NS_LOG_DEBUG ("Adding transmission " << transmission->GetId () <<
+                        " as interference for " << end - now);
 
-//          Simulator::Schedule (delay, &LoraChannel::Receive,
-//                                          this, j, packet, parameters);
-          m_packetSent (packet);
+          phy->AddInterferer (transmission, rxPowerDbm, end - now);
         }
     }
 }
@@ -191,16 +896,549 @@ LoraChannel::Receive (uint32_t i, Ptr<Packet> packet,
 
   // Call the appropriate PHY instance to let it begin reception
   m_phyList[i]->StartReceive (packet, parameters.rxPowerDbm, parameters.sf,
-                              parameters.duration, parameters.frequencyMHz);
+                              parameters.duration, parameters.frequencyMHz,
+                              parameters.transmission);
 }
 
 double
 LoraChannel::GetRxPower (double txPowerDbm, Ptr<MobilityModel> senderMobility,
                          Ptr<MobilityModel> receiverMobility) const
 {
+  if (m_linkTable != 0 && m_linksValid)
+    {
+      std::unordered_map<const MobilityModel *, uint32_t>::const_iterator
+        sender = m_mobilityIndex.find (PeekPointer (senderMobility));
+      std::unordered_map<const MobilityModel *, uint32_t>::const_iterator
+        receiver = m_mobilityIndex.find (PeekPointer (receiverMobility));
+      if (sender != m_mobilityIndex.end () && receiver != m_mobilityIndex.end ())
+        {
+          return txPowerDbm - GetLink (sender->second, receiver->second,
+                                       senderMobility, receiverMobility).lossDb;
+        }
+    }
+
   return m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
 }
 
+LoraChannel::LinkTable::~LinkTable ()
+{
+}
+
+LoraChannel::Link
+LoraChannel::GetLinkBudget (uint32_t sender, uint32_t receiver) const
+{
+  NS_LOG_FUNCTION (this << sender << receiver);
+
+  NS_ASSERT (sender < m_phyList.size () && receiver < m_phyList.size ());
+
+  return ComputeLink (m_phyList[sender]->GetMobility ()->
+                      GetObject<MobilityModel> (),
+                      m_phyList[receiver]->GetMobility ()->
+                      GetObject<MobilityModel> ());
+}
+
+/**
+ * Describe a model by its type and the value of each of its attributes, as
+ * strings. Attributes holding other objects are left out, since their value
+ * is an address that changes from run to run.
+ */
+static std::string
+DescribeModel (Ptr<const Object> model)
+{
+  std::string description = model->GetInstanceTypeId ().GetName ();
+  for (TypeId tid = model->GetInstanceTypeId (); tid != Object::GetTypeId ();
+       tid = tid.GetParent ())
+    {
+      for (std::size_t i = 0; i < tid.GetAttributeN (); i++)
+        {
+          TypeId::AttributeInformation info = tid.GetAttribute (i);
+          std::string type = info.checker->GetValueTypeName ();
+          if (!(info.flags & TypeId::ATTR_GET) || type == "ns3::PointerValue"
+              || type == "ns3::ObjectPtrContainerValue")
+            {
+              continue;
+            }
+
+          StringValue value;
+          model->GetAttribute (info.name, value);
+          description += " " + info.name + "=" + value.Get ();
+        }
+    }
+  return description;
+}
+
+uint64_t
+LoraChannel::GetTopologyChecksum (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  // FNV-1a over the bytes of everything the links depend on
+  uint64_t hash = 14695981039346656037ULL;
+  std::function<void (const void *, size_t)> add =
+    [&hash] (const void *data, size_t size)
+    {
+      const uint8_t *bytes = static_cast<const uint8_t *> (data);
+      for (size_t k = 0; k < size; k++)
+        {
+          hash ^= bytes[k];
+          hash *= 1099511628211ULL;
+        }
+    };
+
+  uint32_t n = m_phyList.size ();
+  add (&n, sizeof (n));
+  int32_t resolution = Time::GetResolution ();
+  add (&resolution, sizeof (resolution));
+
+  if (HasStochasticLoss ())
+    {
+      NS_LOG_WARN ("The loss models are stochastic: links computed now will "
+                   "differ from those of later runs");
+    }
+
+  std::string models;
+  for (Ptr<PropagationLossModel> loss = m_loss; loss != 0;
+       loss = loss->GetNext ())
+    {
+      models += DescribeModel (loss) + ";";
+    }
+  models += DescribeModel (m_delay);
+  add (models.data (), models.size ());
+
+  for (uint32_t j = 0; j < n; j++)
+    {
+      Vector position = m_phyList[j]->GetMobility ()->
+        GetObject<MobilityModel> ()->GetPosition ();
+      add (&position.x, sizeof (position.x));
+      add (&position.y, sizeof (position.y));
+      add (&position.z, sizeof (position.z));
+    }
+
+  return hash;
+}
+
+bool
+LoraChannel::HasStochasticLoss (void) const
+{
+  for (Ptr<PropagationLossModel> loss = m_loss; loss != 0;
+       loss = loss->GetNext ())
+    {
+      std::string name = loss->GetInstanceTypeId ().GetName ();
+      if (name == "ns3::RandomPropagationLossModel"
+          || name == "ns3::NakagamiPropagationLossModel"
+          || name == "ns3::JakesPropagationLossModel")
+        {
+          return true;
+        }
+
+      // A model drawing from a random variable is stochastic too
+      for (TypeId tid = loss->GetInstanceTypeId ();
+           tid != Object::GetTypeId (); tid = tid.GetParent ())
+        {
+          for (std::size_t i = 0; i < tid.GetAttributeN (); i++)
+            {
+              Ptr<const PointerChecker> checker =
+                DynamicCast<const PointerChecker> (tid.GetAttribute (i).checker);
+              if (checker != 0 && checker->GetPointeeTypeId ().IsChildOf
+                    (RandomVariableStream::GetTypeId ()))
+                {
+                  return true;
+                }
+            }
+        }
+    }
+  return false;
+}
+
+void
+LoraChannel::SetLinkTable (Ptr<const LinkTable> table)
+{
+  NS_LOG_FUNCTION (this << table);
+
+  m_linkTable = table;
+  m_mobilityIndex.clear ();
+  if (table == 0)
+    {
+      m_linksValid = false;
+      return;
+    }
+
+  // Drop the table as soon as a PHY moves
+  for (uint32_t j = 0; j < m_phyList.size (); j++)
+    {
+      Ptr<MobilityModel> mobility = m_phyList[j]->GetMobility ()->
+        GetObject<MobilityModel> ();
+      TrackMobility (mobility);
+      m_mobilityIndex[PeekPointer (mobility)] = j;
+    }
+  m_linksValid = true;
+}
+
+double
+LoraChannel::GetCutoffRadius (double txPowerDbm) const
+{
+  NS_LOG_FUNCTION (this << txPowerDbm);
+
+  const double infinity = std::numeric_limits<double>::infinity ();
+
+  if (m_negligibleRxPowerDbm == -infinity)
+    {
+      return infinity;
+    }
+
+  // The radii depend on the loss model
+  if (m_cutoffLoss != m_loss)
+    {
+      m_cutoffRadius.clear ();
+      m_cutoffLoss = m_loss;
+    }
+
+  std::map<double, double>::const_iterator it = m_cutoffRadius.find (txPowerDbm);
+  if (it != m_cutoffRadius.end ())
+    {
+      return it->second;
+    }
+
+  Ptr<ConstantPositionMobilityModel> a =
+    CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b =
+    CreateObject<ConstantPositionMobilityModel> ();
+  a->SetPosition (Vector (0, 0, 0));
+
+  // Double the distance until the power drops below the floor
+  double near = 0;
+  double far = 1;
+  b->SetPosition (Vector (far, 0, 0));
+  while (GetRxPower (txPowerDbm, a, b) >= m_negligibleRxPowerDbm)
+    {
+      near = far;
+      far *= 2;
+      if (far > 1e8)
+        {
+          NS_LOG_DEBUG ("The power never drops below the floor");
+          m_cutoffRadius[txPowerDbm] = infinity;
+          return infinity;
+        }
+      b->SetPosition (Vector (far, 0, 0));
+    }
+
+  // Then bisect, keeping the power at near above the floor
+  while (far - near > 0.1)
+    {
+      double middle = (near + far) / 2;
+      b->SetPosition (Vector (middle, 0, 0));
+      if (GetRxPower (txPowerDbm, a, b) >= m_negligibleRxPowerDbm)
+        {
+          near = middle;
+        }
+      else
+        {
+          far = middle;
+        }
+    }
+
+  NS_LOG_DEBUG ("Cutoff radius for " << txPowerDbm << " dBm: " << far << " m");
+
+  m_cutoffRadius[txPowerDbm] = far;
+  return far;
+}
+
+int64_t
+LoraChannel::GetCell (double coordinate) const
+{
+  return int64_t (std::floor (coordinate / m_cellSize));
+}
+
+void
+LoraChannel::BuildPositions (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  uint32_t n = m_phyList.size ();
+  m_positionX.resize (n);
+  m_positionY.resize (n);
+  m_positionZ.resize (n);
+
+  for (uint32_t j = 0; j < n; j++)
+    {
+      Ptr<MobilityModel> mobility = m_phyList[j]->GetMobility ()->
+        GetObject<MobilityModel> ();
+      NS_ASSERT (mobility != 0);
+
+      // Read the positions again whenever a PHY moves
+      TrackMobility (mobility);
+
+      Vector position = mobility->GetPosition ();
+      m_positionX[j] = position.x;
+      m_positionY[j] = position.y;
+      m_positionZ[j] = position.z;
+    }
+
+  m_positionsValid = true;
+}
+
+void
+LoraChannel::BuildGrid (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  if (!m_positionsValid)
+    {
+      BuildPositions ();
+    }
+
+  m_grid.clear ();
+
+  for (uint32_t j = 0; j < m_phyList.size (); j++)
+    {
+      m_grid[std::make_pair (GetCell (m_positionX[j]),
+                             GetCell (m_positionY[j]))].push_back (j);
+    }
+
+  m_gridValid = true;
+}
+
+void
+LoraChannel::CourseChanged (Ptr<const MobilityModel> mobility) const
+{
+  m_positionsValid = false;
+  m_gridValid = false;
+  m_linksValid = false;
+}
+
+void
+LoraChannel::TrackMobility (Ptr<MobilityModel> mobility) const
+{
+  if (m_trackedMobility.insert (mobility).second)
+    {
+      mobility->TraceConnectWithoutContext
+        ("CourseChange", MakeCallback (&LoraChannel::CourseChanged, this));
+    }
+}
+
+void
+LoraChannel::UntrackMobility (void) const
+{
+  std::set<Ptr<MobilityModel> >::const_iterator it;
+  for (it = m_trackedMobility.begin (); it != m_trackedMobility.end (); it++)
+    {
+      (*it)->TraceDisconnectWithoutContext
+        ("CourseChange", MakeCallback (&LoraChannel::CourseChanged, this));
+    }
+  m_trackedMobility.clear ();
+}
+
+LoraChannel::Link
+LoraChannel::ComputeLink (Ptr<MobilityModel> senderMobility,
+                          Ptr<MobilityModel> receiverMobility) const
+{
+  Link link;
+  link.lossDb = -m_loss->CalcRxPower (0, senderMobility, receiverMobility);
+  link.delay = m_delay->GetDelay (senderMobility, receiverMobility).
+    GetTimeStep ();
+  return link;
+}
+
+void
+LoraChannel::ResetLinks (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  Link empty;
+  empty.lossDb = std::numeric_limits<double>::quiet_NaN ();
+
+  m_sparseLinks.clear ();
+  m_denseLinks.clear ();
+  if (m_phyList.size () <= m_denseLinkLimit)
+    {
+      m_denseLinks.resize (m_phyList.size () * m_phyList.size (), empty);
+    }
+  m_linksValid = true;
+}
+
+LoraChannel::Link
+LoraChannel::GetLink (uint32_t sender, uint32_t receiver,
+                      Ptr<MobilityModel> senderMobility,
+                      Ptr<MobilityModel> receiverMobility) const
+{
+  if (m_linkTable != 0)
+    {
+      if (m_linksValid)
+        {
+          return m_linkTable->GetLinks ()[sender * m_phyList.size () +
+                                          receiver];
+        }
+
+      // A PHY moved since the table was computed
+      NS_LOG_INFO ("Dropping the precomputed links");
+      m_linkTable = 0;
+      if (!m_cacheLinks)
+        {
+          return ComputeLink (senderMobility, receiverMobility);
+        }
+    }
+
+  if (!m_linksValid)
+    {
+      ResetLinks ();
+    }
+
+  Link *link;
+  if (!m_denseLinks.empty ())
+    {
+      link = &m_denseLinks[sender * m_phyList.size () + receiver];
+    }
+  else
+    {
+      uint64_t key = (uint64_t (sender) << 32) | receiver;
+      std::unordered_map<uint64_t, Link>::iterator it = m_sparseLinks.find (key);
+      if (it != m_sparseLinks.end ())
+        {
+          return it->second;
+        }
+      link = &m_sparseLinks[key];
+      link->lossDb = std::numeric_limits<double>::quiet_NaN ();
+    }
+
+  if (std::isnan (link->lossDb))
+    {
+      // Recompute the link whenever one of its ends moves
+      TrackMobility (senderMobility);
+      TrackMobility (receiverMobility);
+      *link = ComputeLink (senderMobility, receiverMobility);
+    }
+
+  return *link;
+}
+
+void
+LoraChannel::GetReceivers (Ptr<MobilityModel> senderMobility,
+                           double txPowerDbm, double frequencyMHz,
+                           std::vector<uint32_t> &receivers) const
+{
+  NS_LOG_FUNCTION (this << senderMobility << txPowerDbm << frequencyMHz);
+
+  receivers.clear ();
+
+  double radius = GetCutoffRadius (txPowerDbm);
+  if (radius == std::numeric_limits<double>::infinity ())
+    {
+      // Merge the PHYs listening to the frequency with those listening to
+      // all frequencies, keeping the order of m_phyList
+      std::map<double, std::vector<uint32_t> >::const_iterator list =
+        m_frequencyLists.find (frequencyMHz);
+      if (list == m_frequencyLists.end ())
+        {
+          receivers = m_allFrequenciesList;
+        }
+      else
+        {
+          receivers.resize (list->second.size () + m_allFrequenciesList.size ());
+          std::merge (list->second.begin (), list->second.end (),
+                      m_allFrequenciesList.begin (), m_allFrequenciesList.end (),
+                      receivers.begin ());
+        }
+      return;
+    }
+
+  if (!m_gridValid)
+    {
+      BuildGrid ();
+    }
+
+  Vector position = senderMobility->GetPosition ();
+  int64_t minX = GetCell (position.x - radius);
+  int64_t maxX = GetCell (position.x + radius);
+  int64_t minY = GetCell (position.y - radius);
+  int64_t maxY = GetCell (position.y + radius);
+
+  // Visit the cells in range, or all the non-empty cells if there are fewer
+  // of them
+  std::map<std::pair<int64_t, int64_t>, std::vector<uint32_t> >::const_iterator cell;
+  std::vector<const std::vector<uint32_t> *> cells;
+  if (double(maxX - minX + 1) * double(maxY - minY + 1) > m_grid.size ())
+    {
+      for (cell = m_grid.begin (); cell != m_grid.end (); cell++)
+        {
+          if (cell->first.first >= minX && cell->first.first <= maxX &&
+              cell->first.second >= minY && cell->first.second <= maxY)
+            {
+              cells.push_back (&cell->second);
+            }
+        }
+    }
+  else
+    {
+      for (int64_t x = minX; x <= maxX; x++)
+        {
+          for (int64_t y = minY; y <= maxY; y++)
+            {
+              cell = m_grid.find (std::make_pair (x, y));
+              if (cell != m_grid.end ())
+                {
+                  cells.push_back (&cell->second);
+                }
+            }
+        }
+    }
+
+  // The grid only looks at x and y, the exact distance also accounts for z
+  for (uint32_t c = 0; c < cells.size (); c++)
+    {
+      const std::vector<uint32_t> &indices = *cells[c];
+      for (uint32_t k = 0; k < indices.size (); k++)
+        {
+          uint32_t j = indices[k];
+          if (CalculateDistance (position, Vector (m_positionX[j],
+                                                   m_positionY[j],
+                                                   m_positionZ[j])) <= radius)
+            {
+              receivers.push_back (indices[k]);
+            }
+        }
+    }
+
+  // Deliver in the same order as without culling
+  std::sort (receivers.begin (), receivers.end ());
+}
+
+void
+LoraChannel::ScheduleEndReceive (Ptr<LoraPhy> phy, Ptr<Packet> packet,
+                                 Ptr<LoraInterferenceHelper::Event> event)
+{
+  NS_LOG_FUNCTION (this << phy << packet << event);
+
+  // The reception may have started in the context of another node when
+  // deliveries are coalesced: go back to that of the receiver, so that it
+  // does not leak into the events scheduled by the upper layers
+  Simulator::ScheduleWithContext (GetContext (phy),
+                                  event->GetEndTime () - Simulator::Now (),
+                                  &LoraPhy::EndReceive, phy, packet, event);
+}
+
+void
+LoraChannel::ReceiveBatch (int64_t tick) const
+{
+  NS_LOG_FUNCTION (this << tick);
+
+  // Take the batch out of the map first, so that deliveries scheduled by the
+  // Receive calls below start a new batch
+  std::vector<PendingDelivery> batch;
+  std::map<int64_t, std::vector<PendingDelivery> >::iterator it =
+    m_pendingDeliveries.find (tick);
+  NS_ASSERT (it != m_pendingDeliveries.end ());
+  batch.swap (it->second);
+  m_pendingDeliveries.erase (it);
+
+  NS_LOG_DEBUG ("Starting " << batch.size () << " receptions");
+
+  for (std::vector<PendingDelivery>::iterator delivery = batch.begin ();
+       delivery != batch.end (); delivery++)
+    {
+      Receive (delivery->i, delivery->packet, delivery->parameters);
+    }
+}
+
 std::ostream &operator << (std::ostream &os, const LoraChannelParameters &params)
 {
   os << "(rxPowerDbm: " << params.rxPowerDbm << ", SF: " << unsigned(params.sf) <<
@@ -208,4 +1446,26 @@ std::ostream &operator << (std::ostream &os, const LoraChannelParameters &params
   ", frequencyMHz: " << params.frequencyMHz << ")";
   return os;
 }
+
+LoraChannelCounters::LoraChannelCounters () :
+  transmissions (0),
+  deliveriesScheduled (0),
+  deliveriesCulled (0)
+{
+}
+
+std::ostream &operator << (std::ostream &os, const LoraChannelCounters &counters)
+{
+  os << "(transmissions: " << counters.transmissions <<
+  ", deliveriesScheduled: " << counters.deliveriesScheduled <<
+  ", deliveriesCulled: " << counters.deliveriesCulled << ", bytes:";
+  std::map<std::pair<uint8_t, double>, uint64_t>::const_iterator it;
+  for (it = counters.bytes.begin (); it != counters.bytes.end (); it++)
+    {
+      os << " SF" << unsigned(it->first.first) << "@" << it->first.second <<
+      "MHz=" << it->second;
+    }
+  os << ")";
+  return os;
+}
 }
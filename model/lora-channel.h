@@ -23,6 +23,10 @@
 #ifndef LORA_CHANNEL_H
 #define LORA_CHANNEL_H
 
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
 #include "ns3/lora-phy.h"
 #include "ns3/mobility-model.h"
@@ -31,8 +35,10 @@
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
 #include "ns3/logical-lora-channel.h"
+#include "ns3/lora-interference-helper.h"
 #include "ns3/packet.h"
 #include "ns3/nstime.h"
+#include "ns3/vector.h"
 
 namespace ns3 {
 
@@ -52,6 +58,8 @@ struct LoraChannelParameters
   uint8_t sf; //!< The Spreading Factor of this transmission.
   Time duration; //!< The duration of the transmission.
   double frequencyMHz; //!< The frequency [MHz] of this transmission.
+  Ptr<const LoraInterferenceHelper::Transmission> transmission; //!< The
+                                          //!description shared by receivers.
 };
 
 /**
@@ -59,6 +67,27 @@ struct LoraChannelParameters
   */
 std::ostream &operator << (std::ostream &os, const LoraChannelParameters &params);
 
+/**
+  * Counters of the activity of a LoraChannel.
+  */
+struct LoraChannelCounters
+{
+  LoraChannelCounters ();
+
+  uint64_t transmissions; //!< The packets sent on the channel.
+  uint64_t deliveriesScheduled; //!< The receptions scheduled at PHYs.
+  uint64_t deliveriesCulled; //!< The PHYs a packet was not delivered to,
+                             //!because they were not listening to its
+                             //!frequency or could not hear it.
+  std::map<std::pair<uint8_t, double>, uint64_t> bytes; //!< The bytes sent,
+                                          //!by SF and frequency [MHz].
+};
+
+/**
+  * Allow logging of LoraChannelCounters like with any other data type.
+  */
+std::ostream &operator << (std::ostream &os, const LoraChannelCounters &counters);
+
 /**
  * The class that delivers packets among PHY layers.
  *
@@ -151,7 +180,485 @@ public:
   double GetRxPower (double txPowerDbm, Ptr<MobilityModel> senderMobility,
                      Ptr<MobilityModel> receiverMobility) const;
 
+  /**
+    * Get the distance beyond which a transmission is received with less than
+    * the NegligibleRxPower, according to the loss model.
+    *
+    * The distance is found by probing the loss model, which is assumed to be
+    * deterministic and not to decrease with distance, and is cached for each
+    * transmission power.
+    *
+    * \param txPowerDbm The power of the transmission, in dBm.
+    * \return The distance, in m, which is infinite if culling is disabled or
+    * the power never drops below the floor.
+    */
+  double GetCutoffRadius (double txPowerDbm) const;
+
+  /**
+    * Schedule the end of a reception at a PHY connected to this channel.
+    *
+    * The EndReceive call is scheduled in the context of the receiving node,
+    * whatever the context the reception started in.
+    *
+    * \param phy The PHY that is receiving the packet.
+    * \param packet The packet being received.
+    * \param event The event tied to the packet in the PHY's
+    * LoraInterferenceHelper. The reception ends when the event ends.
+    */
+  void ScheduleEndReceive (Ptr<LoraPhy> phy, Ptr<Packet> packet,
+                           Ptr<LoraInterferenceHelper::Event> event);
+
+  /**
+    * Deliver to a PHY that just subscribed the transmissions that are still on
+    * the air and that were not delivered to it yet.
+    *
+    * The transmissions that did not reach the PHY yet are delivered as usual,
+    * while the others are only registered as interference for the time they
+    * stay on the air.
+    *
+    * \param phy The PHY that subscribed.
+    */
+  void Replay (Ptr<LoraPhy> phy) const;
+
+  /**
+    * Move a PHY to the receiver lists of the frequencies it listens to.
+    *
+    * This method is called by the PHY when its listening frequencies change.
+    *
+    * \param phy The PHY whose frequencies changed.
+    */
+  void UpdateListeningFrequencies (Ptr<LoraPhy> phy);
+
+  /**
+    * The propagation loss and delay between two PHYs.
+    *
+    * This is a plain record, so that link tables can be stored in files.
+    */
+  struct Link
+  {
+    double lossDb; //!< The loss, NaN if it was not computed yet.
+    int64_t delay; //!< The propagation delay, in time steps.
+  };
+
+  /**
+    * A precomputed table of the links between all the PHYs of the channel.
+    */
+  class LinkTable : public SimpleRefCount<LinkTable>
+  {
+  public:
+    virtual ~LinkTable ();
+
+    /**
+      * Get the links, stored by sender and then by receiver, in the order of
+      * the PHYs in the channel.
+      *
+      * \return A pointer to the first of the links.
+      */
+    virtual const Link * GetLinks (void) const = 0;
+  };
+
+  /**
+    * Compute the link from a PHY to another one using the models of the
+    * channel and the current positions of the PHYs.
+    *
+    * \param sender The index of the sending PHY.
+    * \param receiver The index of the receiving PHY.
+    * \return The link.
+    */
+  Link GetLinkBudget (uint32_t sender, uint32_t receiver) const;
+
+  /**
+    * Get a checksum of what the links of the channel depend on: the number of
+    * PHYs and their positions, the types of the models, the values of their
+    * attributes and the time resolution.
+    *
+    * Attributes holding other objects, such as random variables, are not
+    * part of the checksum.
+    *
+    * \return The checksum.
+    */
+  uint64_t GetTopologyChecksum (void) const;
+
+  /**
+    * Check whether a loss model of the chain is stochastic, in which case the
+    * links of the channel cannot be reused from one run to the other.
+    *
+    * \return Whether a loss model of the chain is known to be stochastic or
+    * has a random variable attribute.
+    */
+  bool HasStochasticLoss (void) const;
+
+  /**
+    * Use a precomputed table instead of the models to find the links between
+    * the PHYs of the channel.
+    *
+    * The table is dropped as soon as a PHY moves, or is added or removed.
+    *
+    * \param table The links between all the PHYs, as returned by
+    * GetLinkBudget.
+    */
+  void SetLinkTable (Ptr<const LinkTable> table);
+
+  /**
+    * Get the counters of the activity of the channel since it was created or
+    * since the last call to ResetCounters.
+    *
+    * \return The counters.
+    */
+  const LoraChannelCounters & GetCounters (void) const;
+
+  /**
+    * Set all the counters of the channel to zero.
+    */
+  void ResetCounters (void);
+
 private:
+  /**
+    * A transmission that may still be on the air at some PHY.
+    */
+  struct OnAirTransmission
+  {
+    Ptr<LoraPhy> sender; //!< The PHY that sent the transmission.
+    Ptr<MobilityModel> senderMobility; //!< The mobility model of the sender.
+    double txPowerDbm; //!< The transmission power.
+    Ptr<Packet> packet; //!< The packet that is being sent.
+    Ptr<const LoraInterferenceHelper::Transmission> transmission; //!< The
+                                          //!description shared by receivers.
+    Time start; //!< The time the transmission was sent.
+    std::vector<const LoraPhy *> delivered; //!< The PHYs it was delivered to.
+  };
+
+  /**
+    * Compute the received power and the delay of a transmission at a PHY.
+    *
+    * \param senderIndex The index of the sender in m_phyList, or the size of
+    * m_phyList if the link cache is not used.
+    * \param receiverIndex The index of the receiver in m_phyList.
+    * \param senderMobility The mobility model of the sender.
+    * \param receiverMobility The mobility model of the receiver.
+    * \param txPowerDbm The power of the transmission.
+    * \param rxPowerDbm Set to the received power.
+    * \param delay Set to the propagation delay.
+    */
+  void Propagate (uint32_t senderIndex, uint32_t receiverIndex,
+                  Ptr<MobilityModel> senderMobility,
+                  Ptr<MobilityModel> receiverMobility, double txPowerDbm,
+                  double &rxPowerDbm, Time &delay) const;
+
+  /**
+    * The parameters of a LogDistancePropagationLossModel and of a
+    * ConstantSpeedPropagationDelayModel, which the channel can evaluate
+    * without calling the models.
+    */
+  struct LogDistanceKernel
+  {
+    double exponent; //!< The path loss exponent.
+    double referenceDistance; //!< The reference distance [m].
+    double referenceLoss; //!< The loss at the reference distance [dB].
+    double speed; //!< The propagation speed [m/s].
+  };
+
+  /**
+    * Get the parameters of the loss and delay models, if they are a single
+    * LogDistancePropagationLossModel and a ConstantSpeedPropagationDelayModel.
+    *
+    * \param kernel Set to the parameters of the models.
+    * \return Whether the models can be evaluated with a LogDistanceKernel.
+    */
+  bool GetLogDistanceKernel (LogDistanceKernel &kernel) const;
+
+  /**
+    * Compute the received power and the delay at all the receivers in
+    * m_receivers at once, into m_rxPowersDbm and m_delays, on the worker
+    * threads if there are enough receivers.
+    *
+    * \param senderMobility The mobility model of the sender.
+    * \param txPowerDbm The power of the transmission.
+    * \return Whether the powers and delays were computed. They are not if
+    * there are no receivers, if links are cached or if the models cannot be
+    * evaluated with a LogDistanceKernel.
+    */
+  bool PropagateWithKernel (Ptr<MobilityModel> senderMobility,
+                            double txPowerDbm) const;
+
+  /**
+    * Schedule the Receive call of a PHY.
+    *
+    * If deliveries are coalesced, the call is batched with all the other
+    * deliveries starting at the same time, once the delay is rounded down to
+    * a multiple of the coalescing tolerance.
+    *
+    * \param i The index of the PHY in m_phyList.
+    * \param packet The packet the PHY will receive.
+    * \param parameters The parameters that characterize this transmission.
+    * \param delay The time until the transmission reaches the PHY.
+    */
+  void Deliver (uint32_t i, Ptr<Packet> packet,
+                LoraChannelParameters parameters, Time delay) const;
+
+  /**
+    * Forget the transmissions that left the air at all the PHYs.
+    */
+  void ForgetOldTransmissions (void) const;
+
+  /**
+    * The transmissions that may still be on the air, in the order they were
+    * sent.
+    */
+  mutable std::deque<OnAirTransmission> m_onAir;
+
+  /**
+    * The longest propagation delay computed so far.
+    */
+  mutable Time m_maxDelay;
+
+  /**
+    * A delivery waiting for its Receive call.
+    */
+  struct PendingDelivery
+  {
+    uint32_t i; //!< The index of the receiving PHY in m_phyList.
+    Ptr<Packet> packet; //!< The packet being delivered.
+    LoraChannelParameters parameters; //!< The parameters of the transmission.
+  };
+
+  /**
+    * Start all the receptions that were scheduled to start at a certain time.
+    *
+    * This runs in the context of the node that sent the first transmission
+    * of the batch, not in that of the receivers, and so do the StartReceive
+    * calls of the PHYs and whatever they schedule. The end of the receptions
+    * is scheduled in the context of the receivers again.
+    *
+    * \param tick The start time of the receptions, in time steps.
+    */
+  void ReceiveBatch (int64_t tick) const;
+
+  /**
+    * Get the id of the node of a PHY, to be used as the context of the
+    * events of the PHY, or 0 if the PHY is not attached to a device.
+    *
+    * \param phy The PHY.
+    */
+  static uint32_t GetContext (Ptr<LoraPhy> phy);
+
+  /**
+    * Find the PHYs a transmission may be delivered to, i.e., those that are
+    * not farther than the cutoff radius from the sender and, when culling is
+    * disabled, those listening to the frequency of the transmission.
+    *
+    * \param senderMobility The mobility model of the sender.
+    * \param txPowerDbm The power of the transmission, in dBm.
+    * \param frequencyMHz The frequency of the transmission.
+    * \param receivers Filled with the indices of the PHYs in m_phyList, in
+    * increasing order.
+    */
+  void GetReceivers (Ptr<MobilityModel> senderMobility, double txPowerDbm,
+                     double frequencyMHz,
+                     std::vector<uint32_t> &receivers) const;
+
+  /**
+    * Add a PHY to the receiver lists of the frequencies it listens to.
+    *
+    * \param i The index of the PHY in m_phyList.
+    */
+  void AddToFrequencyLists (uint32_t i);
+
+  /**
+    * Remove a PHY from all the receiver lists.
+    *
+    * \param i The index of the PHY in m_phyList.
+    */
+  void RemoveFromFrequencyLists (uint32_t i);
+
+  /**
+    * Rebuild the index of the PHYs and the receiver lists, after the indices
+    * of the PHYs changed.
+    */
+  void RebuildFrequencyLists (void);
+
+  /**
+    * Get the loss and delay from a PHY to another one.
+    *
+    * If link caching is enabled, they are computed once with the loss and
+    * delay models and then read from the cache until a PHY moves or the set of
+    * PHYs changes.
+    *
+    * \param sender The index of the sender in m_phyList.
+    * \param receiver The index of the receiver in m_phyList.
+    * \param senderMobility The mobility model of the sender.
+    * \param receiverMobility The mobility model of the receiver.
+    * \return The loss and delay of the link.
+    */
+  Link GetLink (uint32_t sender, uint32_t receiver,
+                Ptr<MobilityModel> senderMobility,
+                Ptr<MobilityModel> receiverMobility) const;
+
+  /**
+    * Compute the loss and delay of a link with the loss and delay models.
+    */
+  Link ComputeLink (Ptr<MobilityModel> senderMobility,
+                    Ptr<MobilityModel> receiverMobility) const;
+
+  /**
+    * Empty the link cache, and size it for the current set of PHYs.
+    */
+  void ResetLinks (void) const;
+
+  /**
+    * Connect to the CourseChange trace of a mobility model, unless it is
+    * already connected.
+    */
+  void TrackMobility (Ptr<MobilityModel> mobility) const;
+
+  /**
+    * Disconnect from the CourseChange trace of all the tracked mobility
+    * models.
+    */
+  void UntrackMobility (void) const;
+
+  /**
+    * Read the current position of the connected PHYs into m_positionX,
+    * m_positionY and m_positionZ.
+    */
+  void BuildPositions (void) const;
+
+  /**
+    * Place the connected PHYs in the cells of the grid, based on their
+    * current position.
+    */
+  void BuildGrid (void) const;
+
+  /**
+    * Invalidate the positions, the grid and the link cache when a PHY moves.
+    */
+  void CourseChanged (Ptr<const MobilityModel> mobility) const;
+
+  /**
+    * Get the coordinate of the grid cell holding a position coordinate.
+    */
+  int64_t GetCell (double coordinate) const;
+
+  /**
+    * Received power [dBm] below which transmissions are not delivered.
+    */
+  double m_negligibleRxPowerDbm;
+
+  /**
+    * The size [m] of the cells of the grid.
+    */
+  double m_cellSize;
+
+  /**
+    * The indices in m_phyList of the PHYs in each cell of the grid, indexed
+    * by the cell's x and y coordinates.
+    */
+  mutable std::map<std::pair<int64_t, int64_t>, std::vector<uint32_t> > m_grid;
+
+  /**
+    * The coordinates of each PHY of m_phyList, as of the last CourseChange of
+    * its mobility model.
+    */
+  mutable std::vector<double> m_positionX;
+  mutable std::vector<double> m_positionY;
+  mutable std::vector<double> m_positionZ;
+
+  /**
+    * Whether m_positionX, m_positionY and m_positionZ reflect the current
+    * positions.
+    */
+  mutable bool m_positionsValid;
+
+  /**
+    * Whether m_grid reflects the current positions.
+    */
+  mutable bool m_gridValid;
+
+  /**
+    * Whether the loss and delay of links are cached.
+    */
+  bool m_cacheLinks;
+
+  /**
+    * The largest number of PHYs for which links are cached in a dense matrix,
+    * rather than in a hash table.
+    */
+  uint32_t m_denseLinkLimit;
+
+  /**
+    * The cached links, in a matrix indexed by sender and receiver index when
+    * there are at most m_denseLinkLimit PHYs.
+    */
+  mutable std::vector<Link> m_denseLinks;
+
+  /**
+    * The cached links, indexed by sender index << 32 | receiver index, when
+    * there are more than m_denseLinkLimit PHYs.
+    */
+  mutable std::unordered_map<uint64_t, Link> m_sparseLinks;
+
+  /**
+    * Whether the link cache holds valid links only.
+    */
+  mutable bool m_linksValid;
+
+  /**
+    * The precomputed links, if any.
+    */
+  mutable Ptr<const LinkTable> m_linkTable;
+
+  /**
+    * The index of the PHY of each mobility model, to look up GetRxPower in
+    * the precomputed links.
+    */
+  std::unordered_map<const MobilityModel *, uint32_t> m_mobilityIndex;
+
+  /**
+    * The mobility models whose CourseChange trace invalidates the positions,
+    * the grid and the link cache.
+    */
+  mutable std::set<Ptr<MobilityModel> > m_trackedMobility;
+
+  /**
+    * The cutoff radius for each transmission power, and the loss model it
+    * was computed with.
+    */
+  mutable std::map<double, double> m_cutoffRadius;
+  mutable Ptr<PropagationLossModel> m_cutoffLoss;
+
+  /**
+    * The index in m_phyList of each PHY.
+    */
+  std::unordered_map<const LoraPhy *, uint32_t> m_phyIndex;
+
+  /**
+    * The indices in m_phyList of the PHYs listening to each frequency, in
+    * increasing order.
+    */
+  std::map<double, std::vector<uint32_t> > m_frequencyLists;
+
+  /**
+    * The indices in m_phyList of the PHYs listening to all frequencies, in
+    * increasing order.
+    */
+  std::vector<uint32_t> m_allFrequenciesList;
+
+  /**
+    * The receivers of the transmission being sent, kept to reuse its storage.
+    */
+  mutable std::vector<uint32_t> m_receivers;
+
+  /**
+    * The received power, delay and coordinates for each element of
+    * m_receivers.
+    */
+  mutable std::vector<double> m_rxPowersDbm;
+  mutable std::vector<Time> m_delays;
+  mutable std::vector<double> m_receiverX;
+  mutable std::vector<double> m_receiverY;
+  mutable std::vector<double> m_receiverZ;
+  mutable std::vector<double> m_delaysSeconds;
+
   /**
     * Private method that is scheduled by LoraChannel's Send method to happen
     * after the channel delay, for each of the connected PHY layers.
@@ -190,6 +697,44 @@ private:
    */
   TracedCallback<Ptr<const Packet> > m_packetSent;
 
+  /**
+    * The counters of the activity of the channel.
+    */
+  mutable LoraChannelCounters m_counters;
+
+  /**
+    * Whether deliveries arriving at the same time share a scheduler event.
+    */
+  bool m_coalesceDeliveries;
+
+  /**
+    * The granularity of the delivery times when deliveries are coalesced.
+    */
+  Time m_coalescingTolerance;
+
+  /**
+    * The deliveries waiting to start, grouped by start time in time steps.
+    */
+  mutable std::map<int64_t, std::vector<PendingDelivery> > m_pendingDeliveries;
+
+  class PropagationWorkers;
+
+  /**
+    * The number of worker threads used to compute the received power and
+    * delay of a transmission.
+    */
+  uint32_t m_propagationThreads;
+
+  /**
+    * The smallest number of receivers for which worker threads are used.
+    */
+  uint32_t m_parallelPropagationThreshold;
+
+  /**
+    * The worker threads, created when first needed.
+    */
+  mutable PropagationWorkers *m_workers;
+
 };
 
 } /* namespace ns3 */
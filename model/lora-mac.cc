@@ -83,9 +83,19 @@ LoraMac::SetPhy (Ptr<LoraPhy> phy)
 
   // Connect the receive callbacks
   m_phy->SetReceiveOkCallback (MakeCallback (&LoraMac::Receive, this));
+  m_phy->SetReceiveOkMetadataCallback (MakeCallback
+                                         (&LoraMac::ReceiveWithMetadata,
+                                         this));
   m_phy->SetTxFinishedCallback (MakeCallback (&LoraMac::TxFinished, this));
 }
 
+void
+LoraMac::ReceiveWithMetadata (Ptr<Packet const> packet,
+                              const LoraReceptionMetadata &metadata)
+{
+  Receive (packet);
+}
+
 LogicalLoraChannelHelper
 LoraMac::GetLogicalLoraChannelHelper (void)
 {
@@ -79,6 +79,18 @@ public:
    */
   virtual void Receive (Ptr<Packet const> packet) = 0;
 
+  /**
+   * Receive a packet from the lower layer, with the metadata of its
+   * reception.
+   *
+   * By default, the metadata is ignored and the packet is passed to Receive.
+   *
+   * \param packet the received packet
+   * \param metadata What the PHY knows about the reception
+   */
+  virtual void ReceiveWithMetadata (Ptr<Packet const> packet,
+                                    const LoraReceptionMetadata &metadata);
+
   /**
    * Perform actions after sending a packet.
    *
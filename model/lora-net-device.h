@@ -90,9 +90,12 @@ public:
    * Callback the Mac layer calls whenever a packet arrives and needs to be
    * forwarded up the stack.
    *
+   * The packet may be shared with the PHY traces, so the upper layers copy it
+   * before modifying it.
+   *
    * \param packet The packet that was received.
    */
-  void Receive (Ptr<Packet> packet);
+  void Receive (Ptr<const Packet> packet);
 
   // From class NetDevice. Some of these have little meaning for a LoRaWAN
   // network device (since, for instance, IP is not used in the standard)
@@ -37,6 +37,20 @@ LoraPhy::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::LoraPhy")
     .SetParent<Object> ()
     .SetGroupName ("lorawan")
+    .AddAttribute ("InterferenceHorizon",
+                   "How long an interfering signal is remembered after its "
+                   "end. It should be at least as long as the longest "
+                   "reception.",
+                   TimeValue (LoraInterferenceHelper::GetMaxOnAirTime ()),
+                   MakeTimeAccessor (&LoraPhy::SetInterferenceHorizon,
+                                     &LoraPhy::GetInterferenceHorizon),
+                   MakeTimeChecker ())
+    .AddTraceSource ("InterferenceEventsHighWater",
+                     "The largest number of signals stored at the same time "
+                     "to compute interference",
+                     MakeTraceSourceAccessor
+                       (&LoraPhy::m_interferenceEventsHighWater),
+                     "ns3::TracedValueCallback::Uint32")
     .AddTraceSource ("StartSending",
                      "Trace source indicating the PHY layer"
                      "has begun the sending process for a packet",
@@ -91,14 +105,129 @@ LoraPhy::GetTypeId (void)
   return tid;
 }
 
-LoraPhy::LoraPhy ()
+LoraPhy::LoraPhy () :
+  m_subscribed (true),
+  m_interferenceEventsHighWater (0)
 {
+  m_interference.SetHighWaterCallback
+    (MakeCallback (&LoraPhy::NotifyInterferenceHighWater, this));
 }
 
 LoraPhy::~LoraPhy ()
 {
 }
 
+void
+LoraPhy::ScheduleEndReceive (Ptr<Packet> packet,
+                             Ptr<LoraInterferenceHelper::Event> event)
+{
+  NS_LOG_FUNCTION (this << packet << event);
+
+  if (m_channel != 0)
+    {
+      m_channel->ScheduleEndReceive (this, packet, event);
+    }
+  else
+    {
+      Simulator::Schedule (event->GetEndTime () - Simulator::Now (),
+                           &LoraPhy::EndReceive, this, packet, event);
+    }
+}
+
+void
+LoraPhy::Subscribe (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_subscribed)
+    {
+      return;
+    }
+
+  m_subscribed = true;
+
+  if (m_channel != 0)
+    {
+      m_channel->Replay (this);
+    }
+}
+
+void
+LoraPhy::Unsubscribe (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_subscribed = false;
+}
+
+bool
+LoraPhy::IsSubscribed (double frequencyMHz) const
+{
+  return m_subscribed && (m_listeningFrequencies.empty () ||
+                          m_listeningFrequencies.count (frequencyMHz));
+}
+
+void
+LoraPhy::SetListeningFrequencies (const std::set<double> &frequencies)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (frequencies == m_listeningFrequencies)
+    {
+      return;
+    }
+
+  m_listeningFrequencies = frequencies;
+
+  if (m_channel != 0)
+    {
+      // Move to the lists of the new frequencies, and get the transmissions
+      // on them that are already on the air
+      m_channel->UpdateListeningFrequencies (this);
+      if (m_subscribed)
+        {
+          m_channel->Replay (this);
+        }
+    }
+}
+
+const std::set<double> &
+LoraPhy::GetListeningFrequencies (void) const
+{
+  return m_listeningFrequencies;
+}
+
+void
+LoraPhy::AddInterferer (Ptr<const LoraInterferenceHelper::Transmission>
+                        transmission, double rxPowerDbm, Time remaining)
+{
+  NS_LOG_FUNCTION (this << transmission << rxPowerDbm << remaining);
+
+  // Only the part of the signal that is still to come can interfere
+  m_interference.Add (remaining, rxPowerDbm,
+                      transmission->GetSpreadingFactor (),
+                      transmission->GetPacket (),
+                      transmission->GetFrequency ());
+}
+
+void
+LoraPhy::SetInterferenceHorizon (Time horizon)
+{
+  m_interference.SetHorizon (horizon);
+}
+
+Time
+LoraPhy::GetInterferenceHorizon (void) const
+{
+  return m_interference.GetHorizon ();
+}
+
+void
+LoraPhy::NotifyInterferenceHighWater (uint32_t nEvents)
+{
+  m_interferenceEventsHighWater = nEvents;
+}
+
 Ptr<NetDevice>
 LoraPhy::GetDevice (void) const
 {
@@ -160,6 +289,12 @@ LoraPhy::SetReceiveOkCallback (RxOkCallback callback)
   m_rxOkCallback = callback;
 }
 
+void
+LoraPhy::SetReceiveOkMetadataCallback (RxOkMetadataCallback callback)
+{
+  m_rxOkMetadataCallback = callback;
+}
+
 void
 LoraPhy::SetTxFinishedCallback (TxFinishedCallback callback)
 {
@@ -300,4 +435,17 @@ std::ostream &operator << (std::ostream &os, const LoraTxParameters &params)
 
   return os;
 }
+
+std::ostream &operator << (std::ostream &os,
+                           const LoraReceptionMetadata &metadata)
+{
+  os << "(gatewayId: " << metadata.gatewayId <<
+  ", senderId: " << metadata.senderId <<
+  ", rxPowerDbm: " << metadata.rxPowerDbm <<
+  ", snir: " << metadata.snir <<
+  ", frequencyMHz: " << metadata.frequencyMHz <<
+  ", SF: " << unsigned(metadata.sf) << ")";
+
+  return os;
+}
 }
@@ -27,6 +27,7 @@
 #include "ns3/callback.h"
 #include "ns3/net-device.h"
 #include "ns3/nstime.h"
+#include "ns3/traced-value.h"
 #include "ns3/mobility-model.h"
 #include "ns3/node.h"
 #include "ns3/lora-channel.h"
@@ -35,6 +36,7 @@
 #include "ns3/lora-energy-consumption-helper.h"
 
 #include <list>
+#include <set>
 
 namespace ns3 {
 
@@ -60,6 +62,27 @@ struct LoraTxParameters
  */
 std::ostream &operator << (std::ostream &os, const LoraTxParameters &params);
 
+/**
+  * Structure to collect what a receiver knows about a packet it received, so
+  * that it can be passed to upper layers alongside the packet instead of being
+  * written in its LoraTag.
+  */
+struct LoraReceptionMetadata
+{
+  uint32_t gatewayId; //!< The node of the receiver, 0 if unknown.
+  uint32_t senderId; //!< The node of the sender.
+  double rxPowerDbm; //!< The reception power.
+  double snir; //!< The SNIR [dB] of the packet.
+  double frequencyMHz; //!< The frequency [MHz] of the packet.
+  uint8_t sf; //!< The Spreading Factor of the packet.
+};
+
+/**
+ * Allow logging of LoraReceptionMetadata like with any other data type.
+ */
+std::ostream &operator << (std::ostream &os,
+                           const LoraReceptionMetadata &metadata);
+
 /**
  * \ingroup lorawan
  *
@@ -91,6 +114,13 @@ public:
    */
   typedef Callback<void, Ptr<const Packet> > RxOkCallback;
 
+  /**
+   * Type definition for a callback for when a packet is correctly received,
+   * which also gets what the PHY knows about the reception.
+   */
+  typedef Callback<void, Ptr<const Packet>, const LoraReceptionMetadata &>
+    RxOkMetadataCallback;
+
   /**
    * Type definition for a callback to call when a packet has finished sending.
    *
@@ -110,10 +140,14 @@ public:
    * \param sf The Spreading Factor of the arriving packet.
    * \param duration The on air time of this packet.
    * \param frequencyMHz The frequency this packet is being transmitted on.
+   * \param transmission The description of the transmission, shared by all
+   * the PHYs receiving it.
    */
   virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm,
                              uint8_t sf, Time duration,
-                             double frequencyMHz) = 0;
+                             double frequencyMHz,
+                             Ptr<const LoraInterferenceHelper::Transmission>
+                             transmission) = 0;
 
   /**
    * Finish reception of a packet.
@@ -130,6 +164,77 @@ public:
   virtual void EndReceive (Ptr<Packet> packet,
                            Ptr<LoraInterferenceHelper::Event> event) = 0;
 
+  /**
+   * Schedule the EndReceive call for a packet, when its event ends.
+   *
+   * If the PHY is connected to a channel, the channel schedules the call in
+   * the context of the PHY's node.
+   *
+   * \param packet The packet being received.
+   * \param event The event that is tied to this packet in the
+   * LoraInterferenceHelper.
+   */
+  void ScheduleEndReceive (Ptr<Packet> packet,
+                           Ptr<LoraInterferenceHelper::Event> event);
+
+  /**
+   * Subscribe to the delivery of transmissions on the listening frequencies.
+   *
+   * The channel only delivers transmissions to subscribed PHYs, and PHYs are
+   * subscribed when created. When a PHY subscribes, the channel delivers it
+   * the transmissions that are still on the air and that it did not receive
+   * yet.
+   */
+  void Subscribe (void);
+
+  /**
+   * Stop the delivery of transmissions to this PHY, for instance because it
+   * does not listen to the channel in its current state.
+   */
+  void Unsubscribe (void);
+
+  /**
+   * Check whether the channel delivers the transmissions on a frequency to
+   * this PHY.
+   *
+   * \param frequencyMHz The frequency of the transmission.
+   * \return Whether the PHY is subscribed and listens to the frequency.
+   */
+  bool IsSubscribed (double frequencyMHz) const;
+
+  /**
+   * Set the frequencies of the transmissions the channel delivers to this
+   * PHY.
+   *
+   * The channel keeps a list of receivers for each frequency, so that a
+   * transmission only visits the PHYs listening to its frequency.
+   *
+   * \param frequencies The frequencies, in MHz. An empty set, the default,
+   * stands for all frequencies.
+   */
+  void SetListeningFrequencies (const std::set<double> &frequencies);
+
+  /**
+   * Get the frequencies of the transmissions the channel delivers to this
+   * PHY.
+   *
+   * \return The frequencies, in MHz, or an empty set for all frequencies.
+   */
+  const std::set<double> &GetListeningFrequencies (void) const;
+
+  /**
+   * Register a signal that was already on the air when the PHY subscribed.
+   *
+   * The signal is only added to the interference helper, since the PHY
+   * cannot lock on a packet whose beginning it missed.
+   *
+   * \param transmission The description of the transmission.
+   * \param rxPowerDbm The power of the signal at this PHY.
+   * \param remaining The time the signal stays on the air.
+   */
+  void AddInterferer (Ptr<const LoraInterferenceHelper::Transmission>
+                      transmission, double rxPowerDbm, Time remaining);
+
   /**
    * Instruct the PHY to send a packet according to some parameters.
    *
@@ -166,6 +271,15 @@ public:
    */
   void SetReceiveOkCallback (RxOkCallback callback);
 
+  /**
+   * Set the callback to call upon successful reception of a packet, with the
+   * metadata of the reception.
+   *
+   * PHYs that support it call this callback instead of the one set with
+   * SetReceiveOkCallback, if it is set.
+   */
+  void SetReceiveOkMetadataCallback (RxOkMetadataCallback callback);
+
   /**
    * Set the callback to call after transmission of a packet.
    *
@@ -238,9 +352,29 @@ public:
 
   static Time GetPreambleTime (uint8_t sf, double bandwidthHz, uint32_t nPreamble);
 
+  /**
+   * Set how long the interference helper keeps signals after their end.
+   */
+  void SetInterferenceHorizon (Time horizon);
+
+  /**
+   * Get how long the interference helper keeps signals after their end.
+   */
+  Time GetInterferenceHorizon (void) const;
+
 private:
+  /**
+   * Update m_interferenceEventsHighWater when the interference helper stores
+   * more events than ever before.
+   */
+  void NotifyInterferenceHighWater (uint32_t nEvents);
+
   Ptr<MobilityModel> m_mobility;   //!< The mobility model associated to this PHY.
 
+  bool m_subscribed; //!< Whether the channel delivers transmissions.
+  std::set<double> m_listeningFrequencies; //!< The frequencies the PHY
+                                           //!listens to, empty for all.
+
 protected:
   // Member objects
 
@@ -322,6 +456,11 @@ protected:
 
   TracedCallback<uint32_t,double,double,double,double, Time> m_dead_device;
 
+  /**
+   * The largest number of events stored by m_interference at the same time.
+   */
+  TracedValue<uint32_t> m_interferenceEventsHighWater;
+
   // Callbacks
 
   /**
@@ -329,6 +468,12 @@ protected:
    */
   RxOkCallback m_rxOkCallback;
 
+  /**
+   * The callback to perform upon correct reception of a packet, with the
+   * metadata of the reception.
+   */
+  RxOkMetadataCallback m_rxOkMetadataCallback;
+
   /**
    * The callback to perform upon the end of a transmission.
    */
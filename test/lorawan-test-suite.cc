@@ -0,0 +1,729 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * LoRaWAN ns-3 module v 0.1.0 - Copyright (c) 2017 University of Padova
+ * LoRaWAN Jamming - Copyright (c) 2019 INSA de Rennes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ns3/lora-channel.h"
+#include "ns3/lora-phy.h"
+#include "ns3/lora-interference-helper.h"
+#include "ns3/lora-tag.h"
+#include "ns3/test.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/packet.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/propagation-loss-model.h"
+#include "ns3/propagation-delay-model.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <vector>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("LorawanTestSuite");
+
+/**
+ * A PHY that only records the power and the time at which transmissions
+ * reach it.
+ */
+class RecordingLoraPhy : public LoraPhy
+{
+public:
+  RecordingLoraPhy () :
+    m_nReceptions (0),
+    m_rxPowerDbm (0)
+  {
+  }
+
+  virtual void StartReceive (Ptr<Packet> packet, double rxPowerDbm,
+                             uint8_t sf, Time duration, double frequencyMHz,
+                             Ptr<const LoraInterferenceHelper::Transmission>
+                             transmission)
+  {
+    m_nReceptions++;
+    m_rxPowerDbm = rxPowerDbm;
+    m_arrival = Simulator::Now ();
+  }
+
+  virtual void EndReceive (Ptr<Packet> packet,
+                           Ptr<LoraInterferenceHelper::Event> event)
+  {
+  }
+
+  virtual void Send (Ptr<Packet> packet, LoraTxParameters txParams,
+                     double frequencyMHz, double txPowerDbm)
+  {
+  }
+
+  virtual bool IsTransmitting (void)
+  {
+    return false;
+  }
+
+  virtual bool IsOnFrequency (double frequency)
+  {
+    return true;
+  }
+
+  uint32_t m_nReceptions; //!< The number of transmissions that reached the PHY
+  double m_rxPowerDbm; //!< The power of the last transmission [dBm]
+  Time m_arrival; //!< The time the last transmission reached the PHY
+};
+
+/**
+ * Check that the received powers and the delays the LoraChannel computes with
+ * its log distance kernel, serially or with worker threads, are those of the
+ * propagation models, for a random topology.
+ */
+class PropagationEquivalenceTestCase : public TestCase
+{
+public:
+  PropagationEquivalenceTestCase ();
+  virtual ~PropagationEquivalenceTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Send a transmission from the first position, and record what the PHYs
+   * at the other positions receive.
+   *
+   * \param loss The loss model of the channel.
+   * \param threads The number of worker threads of the channel.
+   * \param rxPowersDbm The power received at each position.
+   * \param arrivals The time the transmission reached each position.
+   */
+  void Propagate (Ptr<PropagationLossModel> loss, uint32_t threads,
+                  std::vector<double> &rxPowersDbm,
+                  std::vector<Time> &arrivals);
+
+  /**
+   * Compare what the PHYs received in a configuration with the expected
+   * values.
+   */
+  void Compare (std::string configuration,
+                const std::vector<double> &rxPowersDbm,
+                const std::vector<Time> &arrivals);
+
+  std::vector<Vector> m_positions; //!< The positions of the PHYs
+  std::vector<double> m_expectedRxPowersDbm; //!< The powers given by the models
+  std::vector<Time> m_expectedArrivals; //!< The delays given by the models
+
+  static const double s_txPowerDbm; //!< The power of the transmission
+};
+
+const double PropagationEquivalenceTestCase::s_txPowerDbm = 14;
+
+PropagationEquivalenceTestCase::PropagationEquivalenceTestCase ()
+  : TestCase ("Check that the channel computes the rx powers and the delays "
+              "of the propagation models, with and without worker threads")
+{
+}
+
+PropagationEquivalenceTestCase::~PropagationEquivalenceTestCase ()
+{
+}
+
+void
+PropagationEquivalenceTestCase::Propagate (Ptr<PropagationLossModel> loss,
+                                           uint32_t threads,
+                                           std::vector<double> &rxPowersDbm,
+                                           std::vector<Time> &arrivals)
+{
+  Ptr<LoraChannel> channel =
+    CreateObject<LoraChannel> (loss,
+                               CreateObject<ConstantSpeedPropagationDelayModel> ());
+  channel->SetAttribute ("PropagationThreads", UintegerValue (threads));
+  channel->SetAttribute ("ParallelPropagationThreshold", UintegerValue (1));
+
+  std::vector<Ptr<RecordingLoraPhy> > phys;
+  for (uint32_t i = 0; i < m_positions.size (); i++)
+    {
+      Ptr<ConstantPositionMobilityModel> mobility =
+        CreateObject<ConstantPositionMobilityModel> ();
+      mobility->SetPosition (m_positions[i]);
+
+      Ptr<RecordingLoraPhy> phy = CreateObject<RecordingLoraPhy> ();
+      phy->SetMobility (mobility);
+      phy->SetChannel (channel);
+      channel->Add (phy);
+      phys.push_back (phy);
+    }
+
+  Ptr<Packet> packet = Create<Packet> (10);
+  LoraTag tag;
+  packet->AddPacketTag (tag);
+  LoraTxParameters txParams;
+  channel->Send (phys[0], packet, s_txPowerDbm, txParams, Seconds (0.1),
+                 868.1);
+
+  Simulator::Run ();
+
+  rxPowersDbm.clear ();
+  arrivals.clear ();
+  for (uint32_t i = 1; i < phys.size (); i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (phys[i]->m_nReceptions, 1u,
+                             "PHY " << i << " did not receive the "
+                             "transmission exactly once");
+      rxPowersDbm.push_back (phys[i]->m_rxPowerDbm);
+      arrivals.push_back (phys[i]->m_arrival);
+    }
+  NS_TEST_EXPECT_MSG_EQ (phys[0]->m_nReceptions, 0u,
+                         "The sender received its own transmission");
+
+  Simulator::Destroy ();
+}
+
+void
+PropagationEquivalenceTestCase::Compare (std::string configuration,
+                                         const std::vector<double> &rxPowersDbm,
+                                         const std::vector<Time> &arrivals)
+{
+  NS_TEST_ASSERT_MSG_EQ (rxPowersDbm.size (), m_expectedRxPowersDbm.size (),
+                         configuration << ": wrong number of receivers");
+
+  // The results must be bit-identical, not only close
+  for (uint32_t i = 0; i < rxPowersDbm.size (); i++)
+    {
+      NS_TEST_EXPECT_MSG_EQ (rxPowersDbm[i], m_expectedRxPowersDbm[i],
+                             configuration << ": rx power of PHY " << i + 1);
+      NS_TEST_EXPECT_MSG_EQ (arrivals[i], m_expectedArrivals[i],
+                             configuration << ": arrival time at PHY " << i + 1);
+    }
+}
+
+void
+PropagationEquivalenceTestCase::DoRun (void)
+{
+  RngSeedManager::SetSeed (1);
+  RngSeedManager::SetRun (1);
+
+  // A random topology around the sender, with a receiver closer than the
+  // reference distance of the loss model
+  Ptr<UniformRandomVariable> horizontal = CreateObject<UniformRandomVariable> ();
+  horizontal->SetAttribute ("Min", DoubleValue (-10000));
+  horizontal->SetAttribute ("Max", DoubleValue (10000));
+  Ptr<UniformRandomVariable> vertical = CreateObject<UniformRandomVariable> ();
+  vertical->SetAttribute ("Min", DoubleValue (0));
+  vertical->SetAttribute ("Max", DoubleValue (30));
+
+  m_positions.clear ();
+  m_positions.push_back (Vector (12.5, -3.25, 15));
+  m_positions.push_back (Vector (12.75, -3.25, 15));
+  for (uint32_t i = 0; i < 500; i++)
+    {
+      m_positions.push_back (Vector (horizontal->GetValue (),
+                                     horizontal->GetValue (),
+                                     vertical->GetValue ()));
+    }
+
+  // What the models give for each receiver
+  Ptr<LogDistancePropagationLossModel> loss =
+    CreateObject<LogDistancePropagationLossModel> ();
+  loss->SetPathLossExponent (3.76);
+  loss->SetReference (1, 7.7);
+  Ptr<ConstantSpeedPropagationDelayModel> delay =
+    CreateObject<ConstantSpeedPropagationDelayModel> ();
+
+  Ptr<ConstantPositionMobilityModel> senderMobility =
+    CreateObject<ConstantPositionMobilityModel> ();
+  senderMobility->SetPosition (m_positions[0]);
+  m_expectedRxPowersDbm.clear ();
+  m_expectedArrivals.clear ();
+  for (uint32_t i = 1; i < m_positions.size (); i++)
+    {
+      Ptr<ConstantPositionMobilityModel> receiverMobility =
+        CreateObject<ConstantPositionMobilityModel> ();
+      receiverMobility->SetPosition (m_positions[i]);
+      m_expectedRxPowersDbm.push_back
+        (loss->CalcRxPower (s_txPowerDbm, senderMobility, receiverMobility));
+      m_expectedArrivals.push_back
+        (delay->GetDelay (senderMobility, receiverMobility));
+    }
+
+  std::vector<double> rxPowersDbm;
+  std::vector<Time> arrivals;
+
+  // The kernel on the simulation thread
+  Propagate (loss, 0, rxPowersDbm, arrivals);
+  Compare ("Serial", rxPowersDbm, arrivals);
+
+  // The kernel split among worker threads
+  Propagate (loss, 3, rxPowersDbm, arrivals);
+  Compare ("Threaded", rxPowersDbm, arrivals);
+
+  // The models, called by the channel: a chained loss model that does not
+  // change the power prevents the use of the kernel
+  Ptr<LogDistancePropagationLossModel> chainedLoss =
+    CreateObject<LogDistancePropagationLossModel> ();
+  chainedLoss->SetPathLossExponent (3.76);
+  chainedLoss->SetReference (1, 7.7);
+  Ptr<RangePropagationLossModel> range =
+    CreateObject<RangePropagationLossModel> ();
+  range->SetAttribute ("MaxRange", DoubleValue (1e9));
+  chainedLoss->SetNext (range);
+  Propagate (chainedLoss, 0, rxPowersDbm, arrivals);
+  Compare ("Models", rxPowersDbm, arrivals);
+}
+
+/**
+ * Check that the interference models decide as the original implementation
+ * of each model, which compared every pair of events in the time domain, for
+ * random events.
+ */
+class InterferenceDecisionTestCase : public TestCase
+{
+public:
+  InterferenceDecisionTestCase ();
+  virtual ~InterferenceDecisionTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * An event, as the original implementation saw it.
+   */
+  struct ReferenceEvent
+  {
+    Time start; //!< The start of the event
+    Time end; //!< The end of the event
+    Time preamble; //!< The duration of the preamble of the event
+    uint8_t sf; //!< The SF of the event
+    double frequencyMHz; //!< The frequency of the event
+    double rxPowerDbm; //!< The received power of the event
+  };
+
+  /**
+   * Add the event to the helpers.
+   */
+  void StartEvent (uint32_t i);
+
+  /**
+   * Compare the evaluation of the event by the helpers with the reference.
+   */
+  void EndEvent (uint32_t i);
+
+  /**
+   * Decide whether an event is destroyed with the original implementation
+   * of a model.
+   *
+   * \param model The interference model.
+   * \param i The index of the event.
+   * \param margin The smallest distance of a compared quantity to its
+   * threshold [dB], where the two implementations may round differently.
+   * \return Whether the event is destroyed.
+   */
+  bool IsDestroyed (LoraInterferenceHelper::Int_Model model, uint32_t i,
+                    double &margin) const;
+
+  /**
+   * The SINR of an event with the original implementation.
+   */
+  double GetSinr (uint32_t i) const;
+
+  /**
+   * The overlap of two events, as computed by the original implementation.
+   */
+  static Time GetOverlapTime (const ReferenceEvent &event1,
+                              const ReferenceEvent &event2);
+
+  /**
+   * Whether event2 hits the preamble of event1, as computed by the original
+   * implementation.
+   */
+  static bool OnThePreamble (const ReferenceEvent &event1,
+                             const ReferenceEvent &event2);
+
+  /**
+   * The energy of the interferers overlapping with an event, per SF.
+   *
+   * \param i The index of the event.
+   * \param crossSf Whether to include the interferers using another SF.
+   * \param energy The energy of each SF [J], index 0 is SF7.
+   */
+  void GetInterferenceEnergy (uint32_t i, bool crossSf,
+                              double energy[6]) const;
+
+  std::vector<ReferenceEvent> m_events; //!< The events
+  std::vector<Ptr<Packet> > m_packets; //!< The packets of the events
+
+  static const uint32_t s_nModels = 4; //!< The number of models
+  static const double s_delta; //!< The delta of the models [dB]
+  LoraInterferenceHelper *m_helpers[s_nModels]; //!< A helper for each model
+  std::vector<Ptr<LoraInterferenceHelper::Event> >
+  m_helperEvents[s_nModels]; //!< The event of each helper for each event
+  uint32_t m_nDestroyed[s_nModels]; //!< The number of destroyed events
+  uint32_t m_nSkipped; //!< The decisions too close to a threshold to compare
+};
+
+const double InterferenceDecisionTestCase::s_delta = 6;
+
+InterferenceDecisionTestCase::InterferenceDecisionTestCase ()
+  : TestCase ("Check that the interference models decide as the original "
+              "implementation of each model"),
+  m_nSkipped (0)
+{
+  for (uint32_t m = 0; m < s_nModels; m++)
+    {
+      m_helpers[m] = 0;
+      m_nDestroyed[m] = 0;
+    }
+}
+
+InterferenceDecisionTestCase::~InterferenceDecisionTestCase ()
+{
+}
+
+Time
+InterferenceDecisionTestCase::GetOverlapTime (const ReferenceEvent &event1,
+                                              const ReferenceEvent &event2)
+{
+  Time s1 = event1.start;
+  Time s2 = event2.start;
+  Time e1 = event1.end;
+  Time e2 = event2.end;
+
+  if (s1 < s2)
+    {
+      if (e1 < s2)
+        {
+          return Seconds (0);
+        }
+      return e1 >= e2 ? e2 - s2 : e1 - s2;
+    }
+  if (e2 < s1)
+    {
+      return Seconds (0);
+    }
+  return e2 >= e1 ? e1 - s1 : e2 - s1;
+}
+
+bool
+InterferenceDecisionTestCase::OnThePreamble (const ReferenceEvent &event1,
+                                             const ReferenceEvent &event2)
+{
+  if (event1.start < event2.start)
+    {
+      if (event1.end < event2.start)
+        {
+          return false;
+        }
+      return event2.start <= event1.start + event1.preamble;
+    }
+  return true;
+}
+
+void
+InterferenceDecisionTestCase::GetInterferenceEnergy (uint32_t i, bool crossSf,
+                                                     double energy[6]) const
+{
+  const ReferenceEvent &event = m_events[i];
+  std::fill (energy, energy + 6, 0.0);
+  for (uint32_t j = 0; j < m_events.size (); j++)
+    {
+      const ReferenceEvent &interferer = m_events[j];
+      if (j == i || interferer.frequencyMHz != event.frequencyMHz ||
+          (!crossSf && interferer.sf != event.sf))
+        {
+          continue;
+        }
+
+      Time overlap = GetOverlapTime (event, interferer);
+      double interfererPowerW = std::pow (10, interferer.rxPowerDbm / 10) / 1000;
+      energy[unsigned(interferer.sf) - 7] +=
+        overlap.GetSeconds () * interfererPowerW;
+    }
+}
+
+double
+InterferenceDecisionTestCase::GetSinr (uint32_t i) const
+{
+  const ReferenceEvent &event = m_events[i];
+  double energy[6];
+  GetInterferenceEnergy (i, false, energy);
+
+  double signalEnergy = std::pow (10, event.rxPowerDbm / 10) / 1000 *
+    (event.end - event.start).GetSeconds ();
+  double sigma = std::pow (10, -123/10) / 1000;
+  return 10 * std::log10 (signalEnergy /
+                          (energy[unsigned(event.sf) - 7] + sigma));
+}
+
+bool
+InterferenceDecisionTestCase::IsDestroyed
+  (LoraInterferenceHelper::Int_Model model, uint32_t i, double &margin) const
+{
+  const ReferenceEvent &event = m_events[i];
+  unsigned sfIndex = unsigned(event.sf) - 7;
+  double signalEnergy = (event.end - event.start).GetSeconds () *
+    (std::pow (10, event.rxPowerDbm / 10) / 1000);
+  margin = std::numeric_limits<double>::infinity ();
+
+  if (model == LoraInterferenceHelper::Pure_ALOHA)
+    {
+      for (uint32_t j = 0; j < m_events.size (); j++)
+        {
+          if (j != i && m_events[j].frequencyMHz == event.frequencyMHz &&
+              m_events[j].sf == event.sf &&
+              GetOverlapTime (event, m_events[j]).GetSeconds () != 0)
+            {
+              return true;
+            }
+        }
+      return false;
+    }
+
+  if (model == LoraInterferenceHelper::CE_PowerLevel)
+    {
+      double maxInterferenceLevel = -1000;
+      for (uint32_t j = 0; j < m_events.size (); j++)
+        {
+          if (j != i && m_events[j].frequencyMHz == event.frequencyMHz &&
+              m_events[j].sf == event.sf &&
+              GetOverlapTime (event, m_events[j]).GetSeconds () != 0)
+            {
+              maxInterferenceLevel = std::max (m_events[j].rxPowerDbm,
+                                               maxInterferenceLevel);
+            }
+        }
+      double eventDelta = std::abs (event.rxPowerDbm - maxInterferenceLevel);
+      return !(eventDelta >= s_delta &&
+               event.rxPowerDbm > maxInterferenceLevel);
+    }
+
+  double energy[6];
+
+  if (model == LoraInterferenceHelper::CE_CumulEnergy)
+    {
+      GetInterferenceEnergy (i, false, energy);
+      double snir = 10 * std::log10 (signalEnergy / energy[sfIndex]);
+      margin = std::abs (snir - s_delta);
+      return !(snir >= s_delta);
+    }
+
+  // Cochannel_Matrix
+  static const double collisionSnir[6][6] =
+  {
+    //   7   8   9  10  11  12
+    {    6, -16, -18, -19, -19, -20},  // SF7
+    {  -24,   6, -20, -22, -22, -22},  // SF8
+    {  -27, -27,   6, -23, -25, -25},  // SF9
+    {  -30, -30, -30,   6, -26, -28},  // SF10
+    {  -33, -33, -33, -33,   6, -29},  // SF11
+    {  -36, -36, -36, -36, -36,   6}   // SF12
+  };
+
+  GetInterferenceEnergy (i, true, energy);
+
+  bool destroyed = false;
+  for (unsigned k = 0; k < 6; k++)
+    {
+      double snir = 10 * std::log10 (signalEnergy / energy[k]);
+      margin = std::min (margin, std::abs (snir - collisionSnir[sfIndex][k]));
+      if (!(snir >= collisionSnir[sfIndex][k]))
+        {
+          destroyed = true;
+        }
+    }
+
+  // Capture effect: the event started before all the overlapping
+  // interferers, none of which hit its preamble
+  uint32_t nInterferers = 0;
+  uint32_t nLaterInterferers = 0;
+  uint32_t nPreambleInterferers = 0;
+  for (uint32_t j = 0; j < m_events.size (); j++)
+    {
+      if (j == i || m_events[j].frequencyMHz != event.frequencyMHz ||
+          GetOverlapTime (event, m_events[j]).GetSeconds () == 0)
+        {
+          continue;
+        }
+      nInterferers++;
+      if (OnThePreamble (event, m_events[j]))
+        {
+          nPreambleInterferers++;
+        }
+      if (event.start < m_events[j].start)
+        {
+          nLaterInterferers++;
+        }
+    }
+
+  if (nLaterInterferers == nInterferers && nPreambleInterferers == 0)
+    {
+      double snir = 10 * std::log10 (signalEnergy / energy[sfIndex]);
+      if (snir >= collisionSnir[sfIndex][sfIndex])
+        {
+          destroyed = false;
+        }
+    }
+
+  return destroyed;
+}
+
+void
+InterferenceDecisionTestCase::StartEvent (uint32_t i)
+{
+  const ReferenceEvent &event = m_events[i];
+  for (uint32_t m = 0; m < s_nModels; m++)
+    {
+      m_helperEvents[m][i] = m_helpers[m]->Add (event.end - event.start,
+                                                event.rxPowerDbm, event.sf,
+                                                m_packets[i],
+                                                event.frequencyMHz);
+    }
+}
+
+void
+InterferenceDecisionTestCase::EndEvent (uint32_t i)
+{
+  double referenceSinr = GetSinr (i);
+
+  for (uint32_t m = 0; m < s_nModels; m++)
+    {
+      LoraInterferenceHelper::Int_Model model =
+        LoraInterferenceHelper::Int_Model (m);
+      LoraInterferenceHelper::Result result =
+        m_helpers[m]->Evaluate (m_helperEvents[m][i]);
+
+      NS_TEST_EXPECT_MSG_EQ_TOL (result.sinr, referenceSinr, 1e-6,
+                                 "SINR of event " << i << " with model " << m);
+
+      double margin;
+      bool destroyed = IsDestroyed (model, i, margin);
+
+      // The helper compares energies in the linear domain, and accumulates
+      // them in time steps: the decisions on a threshold may round
+      // differently
+      if (margin < 1e-6)
+        {
+          m_nSkipped++;
+          continue;
+        }
+
+      NS_TEST_EXPECT_MSG_EQ (result.destroyed, destroyed,
+                             "Decision on event " << i << " with model " << m);
+      if (result.destroyed)
+        {
+          m_nDestroyed[m]++;
+        }
+    }
+}
+
+void
+InterferenceDecisionTestCase::DoRun (void)
+{
+  RngSeedManager::SetSeed (1);
+  RngSeedManager::SetRun (1);
+
+  Ptr<UniformRandomVariable> uniform = CreateObject<UniformRandomVariable> ();
+
+  // Random events on two frequencies, dense enough for all the models to
+  // destroy some of them and let others survive. The start times are
+  // distinct, since the original implementation did not define which of two
+  // events starting together came first.
+  const uint32_t nEvents = 400;
+  const double frequencies[2] = {868.1, 868.3};
+  std::set<int64_t> startTicks;
+  m_events.clear ();
+  m_packets.clear ();
+  while (m_events.size () < nEvents)
+    {
+      ReferenceEvent event;
+      event.start = NanoSeconds (uniform->GetInteger (1, 4000000000u));
+      if (!startTicks.insert (event.start.GetTimeStep ()).second)
+        {
+          continue;
+        }
+      event.sf = uint8_t (uniform->GetInteger (7, 12));
+      event.end = event.start +
+        NanoSeconds (uniform->GetInteger (20000000, 400000000));
+      event.preamble = NanoSeconds (uniform->GetInteger (5000000, 15000000));
+      event.frequencyMHz = frequencies[uniform->GetInteger (0, 1)];
+      event.rxPowerDbm = uniform->GetValue (-130, -100);
+      m_events.push_back (event);
+
+      Ptr<Packet> packet = Create<Packet> (10);
+      LoraTag tag;
+      tag.SetSpreadingFactor (event.sf);
+      tag.SetPreamble (event.preamble.GetSeconds ());
+      packet->AddPacketTag (tag);
+      m_packets.push_back (packet);
+    }
+
+  for (uint32_t m = 0; m < s_nModels; m++)
+    {
+      m_helpers[m] = new LoraInterferenceHelper ();
+      m_helpers[m]->SetInterferenceModel (LoraInterferenceHelper::Int_Model (m));
+      m_helpers[m]->SetDelta (s_delta);
+      m_helperEvents[m].assign (nEvents, 0);
+      m_nDestroyed[m] = 0;
+    }
+  m_nSkipped = 0;
+
+  for (uint32_t i = 0; i < nEvents; i++)
+    {
+      Simulator::Schedule (m_events[i].start,
+                           &InterferenceDecisionTestCase::StartEvent, this, i);
+      Simulator::Schedule (m_events[i].end,
+                           &InterferenceDecisionTestCase::EndEvent, this, i);
+    }
+
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_LOG_DEBUG ("Decisions too close to a threshold: " << m_nSkipped);
+
+  for (uint32_t m = 0; m < s_nModels; m++)
+    {
+      delete m_helpers[m];
+      m_helpers[m] = 0;
+      m_helperEvents[m].clear ();
+
+      NS_LOG_DEBUG ("Model " << m << " destroyed " << m_nDestroyed[m] <<
+                    " events");
+      NS_TEST_EXPECT_MSG_GT (m_nDestroyed[m], 0u,
+                             "Model " << m << " destroyed no event");
+      NS_TEST_EXPECT_MSG_LT (m_nDestroyed[m], nEvents,
+                             "Model " << m << " destroyed all the events");
+    }
+}
+
+/**
+ * The test suite of the lorawan module.
+ */
+class LorawanTestSuite : public TestSuite
+{
+public:
+  LorawanTestSuite ();
+};
+
+LorawanTestSuite::LorawanTestSuite ()
+  : TestSuite ("lorawan", UNIT)
+{
+  AddTestCase (new PropagationEquivalenceTestCase, TestCase::QUICK);
+  AddTestCase (new InterferenceDecisionTestCase, TestCase::QUICK);
+}
+
+static LorawanTestSuite g_lorawanTestSuite;